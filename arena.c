@@ -0,0 +1,101 @@
+#include "arena.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * Function that reserves the space of the arena without backing it,
+ * the kernel only gives it pages where allocations touch it
+ */
+bool arenaInit(struct Arena *a, size_t reserve)
+{
+	memset(a, 0, sizeof(*a));
+	a->base = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (a->base == MAP_FAILED)
+	{
+		a->base = NULL;
+		return false;
+	}
+	a->reserved = reserve;
+	return true;
+}
+
+/**
+ * Function that bumps the used mark past an aligned block with a
+ * compare and swap, so threads can allocate without a lock
+ */
+void *arenaAlloc(struct Arena *a, enum ArenaTag tag, size_t bytes)
+{
+	size_t used = __atomic_load_n(&a->used, __ATOMIC_RELAXED);
+	size_t start, end, high;
+
+	do
+	{
+		start = (used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+		end = start + bytes;
+		if (end > a->reserved || end < start)
+		{
+			__atomic_fetch_add(&a->failed, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&a->used, &used, end, true,
+	                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	__atomic_fetch_add(&a->count[tag], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&a->bytes[tag], bytes, __ATOMIC_RELAXED);
+
+	high = __atomic_load_n(&a->high_water, __ATOMIC_RELAXED);
+	while (end > high && !__atomic_compare_exchange_n(&a->high_water, &high, end, true,
+	                                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return a->base + start;
+}
+
+/**
+ * Function that empties the arena by moving the used mark back to the
+ * start, the pages stay so the next session does not fault them in again
+ */
+void arenaReset(struct Arena *a)
+{
+	a->used = 0;
+	a->failed = 0;
+	memset(a->count, 0, sizeof(a->count));
+	memset(a->bytes, 0, sizeof(a->bytes));
+}
+
+/**
+ * Function that copies the counters
+ */
+void arenaGetStats(struct Arena *a, struct ArenaStats *out)
+{
+	int i;
+
+	for (i = 0; i < ARENA_TAGS; i++)
+	{
+		out->count[i] = __atomic_load_n(&a->count[i], __ATOMIC_RELAXED);
+		out->bytes[i] = __atomic_load_n(&a->bytes[i], __ATOMIC_RELAXED);
+	}
+	out->used = __atomic_load_n(&a->used, __ATOMIC_RELAXED);
+	out->high_water = __atomic_load_n(&a->high_water, __ATOMIC_RELAXED);
+	out->failed = __atomic_load_n(&a->failed, __ATOMIC_RELAXED);
+}
+
+/**
+ * Function that names a tag
+ */
+const char *arenaTagName(enum ArenaTag tag)
+{
+	static const char *names[ARENA_TAGS] = {"board", "grid", "screen", "render", "workers"};
+
+	return names[tag];
+}
+
+/**
+ * Function that unmaps the reserved space
+ */
+void arenaDestroy(struct Arena *a)
+{
+	if (a->base != NULL)
+		munmap(a->base, a->reserved);
+	memset(a, 0, sizeof(*a));
+}
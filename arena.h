@@ -0,0 +1,75 @@
+/***************************************************************
+ *  Header file for the session arena. Every allocation a game
+ *  makes is cut from one block of reserved address space and
+ *  counted under the kind of object it holds. Nothing is freed
+ *  on its own, the whole arena is emptied in one step when the
+ *  game ends and keeps its pages for the next game, so no
+ *  valgrind run is needed to know what a game used
+ *  Refer to arena.c for detailed use of code
+****************************************************************/
+#ifndef ARENA_H
+#define ARENA_H
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Address space reserved for the session of exampleRun(), pages are only
+// backed once touched. Games made by gameCreate() reserve just their board
+#define ARENA_RESERVE (1UL << 30)
+
+// Every allocation starts on a cache line of its own
+#define ARENA_ALIGN 64
+
+// Enumeration to store the kinds of object an arena holds
+enum ArenaTag
+{
+    ARENA_BOARD,                    // Board image and text
+    ARENA_GRID,                     // Collision grid
+    ARENA_SCREEN,                   // Console cell buffers and output buffer
+    ARENA_RENDER,                   // Render rings
+    ARENA_WORKERS,                  // Worker pool
+    ARENA_TAGS
+};
+
+// Struct to store what a session allocated
+struct ArenaStats
+{
+    unsigned long count[ARENA_TAGS];        // Allocations of each kind
+    unsigned long long bytes[ARENA_TAGS];   // Bytes asked for of each kind
+    unsigned long long used;        // Bytes taken, alignment included
+    unsigned long long high_water;  // Most bytes any session took, all backed by pages
+    unsigned long failed;           // Allocations that did not fit
+};
+
+// Struct to store an arena, allocations may come from any thread
+struct Arena
+{
+    char *base;                     // Start of the reserved space
+    size_t reserved;                // Bytes reserved
+    size_t used;                    // Bytes taken so far
+    size_t high_water;
+    unsigned long count[ARENA_TAGS];
+    size_t bytes[ARENA_TAGS];
+    unsigned long failed;
+};
+
+// Reserves reserve bytes of address space, returns false on failure
+bool arenaInit(struct Arena *a, size_t reserve);
+
+// Returns bytes of uninitialized memory counted under tag, NULL if they do not fit
+void *arenaAlloc(struct Arena *a, enum ArenaTag tag, size_t bytes);
+
+// Releases every allocation at once, nothing allocated may be used after it
+void arenaReset(struct Arena *a);
+
+// Copies the counters of the allocations made since the last reset
+void arenaGetStats(struct Arena *a, struct ArenaStats *out);
+
+// Name of the kind of object a tag counts
+const char *arenaTagName(enum ArenaTag tag);
+
+// Gives the reserved space back
+void arenaDestroy(struct Arena *a);
+
+#endif
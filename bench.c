@@ -0,0 +1,216 @@
+/***************************************************************
+ *  Stress benchmark for the game engine. Runs endless headless
+ *  games for a matrix of scenarios, each in its own process so
+ *  peak memory is per scenario, and prints one JSON object per
+ *  line so builds can be compared with standard tools
+ *  Usage: centipede_bench [--ticks N] [--enemies N] [--fire N]
+ *                         [--rows N] [--cols N]
+****************************************************************/
+
+#include "console.h"
+#include "example.h"
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Ticks simulated by each scenario unless given on the command line
+#define BENCH_TICKS 20000
+
+// How often the sampler thread counts the threads of the process
+#define SAMPLE_USEC 5000
+
+// Struct to store the parameters of one scenario
+struct Scenario
+{
+    unsigned int enemies;       // Caterpillars spawned, one every ENEMY_MOV_TICKS
+    unsigned int fire_ticks;    // Ticks between two player shots, 0 for no fire
+    int rows;                   // Board size
+    int cols;
+};
+
+// Default scenario matrix, every scenario runs on the smallest board
+// and on a large one so frame cost can be compared against board area
+static const unsigned int ENEMY_COUNTS[] = {1, 8, 64, 256};
+static const unsigned int FIRE_TICKS[] = {0, 15, 1};
+static const int BOARD_SIZES[][2] = {{MIN_GAME_ROWS, MIN_GAME_COLS}, {100, 300}};
+
+// Peak number of threads seen by the sampler, and whether to keep sampling
+static volatile int peak_threads;
+static volatile bool sampling;
+
+/**
+ * Helper function that reads the number of threads of this process
+ */
+static int countThreads()
+{
+	char line[128];
+	int threads = 0;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (f == NULL)
+		return 0;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (sscanf(line, "Threads: %d", &threads) == 1)
+			break;
+
+	fclose(f);
+	return threads;
+}
+
+/**
+ * Function that keeps track of the peak thread count while a game runs
+ */
+static void *samplerThreadFun(void *arg)
+{
+	int n;
+
+	while (sampling)
+	{
+		n = countThreads();
+		if (n > peak_threads)
+			peak_threads = n;
+		usleep(SAMPLE_USEC);
+	}
+	return NULL;
+}
+
+/**
+ * Function that runs one scenario and prints its results,
+ * meant to be run in a child process of its own
+ */
+static void runScenario(const struct Scenario *sc, unsigned long ticks)
+{
+	struct GameOptions opts = {true, ticks, NULL, SCRIPT_KEY_TICKS, sc->enemies, ENEMY_MOV_TICKS, true,
+	                           0, NULL, NULL, sc->rows, sc->cols, false, DEFAULT_MAX_FPS,
+	                           false, 0, NULL, SOAK_LOG_SECS};
+	struct GameReport report;
+	struct rusage usage;
+	pthread_t sampler;
+	double secs, sim_ns, frames;
+
+	if (sc->fire_ticks > 0)
+	{
+		opts.script = " ";
+		opts.script_ticks = sc->fire_ticks;
+	}
+
+	peak_threads = 0;
+	sampling = true;
+	pthread_create(&sampler, NULL, samplerThreadFun, NULL);
+
+	exampleRun(&opts, &report);
+
+	sampling = false;
+	pthread_join(sampler, NULL);
+	getrusage(RUSAGE_SELF, &usage);
+
+	secs = report.run_ns / 1e9;
+	sim_ns = report.ticks > 0 ? (double)(report.run_ns - report.render_ns) / report.ticks : 0.0;
+	frames = report.frames > 0 ? report.frames : 1;
+
+	printf("{\"enemies\":%u,\"fire_ticks\":%u,\"rows\":%d,\"cols\":%d,\"ticks\":%lu,"
+	       "\"ticks_per_sec\":%.0f,\"sim_ns_per_tick\":%.0f,\"render_ns_per_frame\":%.0f,"
+	       "\"cells_per_frame\":%.1f,\"scanned_per_frame\":%.1f,"
+	       "\"frame_p50_ns\":%llu,\"frame_p99_ns\":%llu,\"frame_max_ns\":%llu,"
+	       "\"peak_rss_kb\":%ld,\"arena_kb\":%.1f,\"threads\":%d}\n",
+	       sc->enemies, sc->fire_ticks, sc->rows, sc->cols, report.ticks,
+	       secs > 0 ? report.ticks / secs : 0.0, sim_ns,
+	       report.render_ns / frames, report.cells / frames, report.scanned / frames,
+	       histPercentile(&report.frame_time, 50.0), histPercentile(&report.frame_time, 99.0),
+	       report.frame_time.max, usage.ru_maxrss, report.memory.high_water / 1024.0,
+	       peak_threads - 1);	// The sampler itself is not part of the game
+	fflush(stdout);
+}
+
+/**
+ * Function that forks a child for a scenario and waits for it,
+ * returns false if the child did not exit cleanly
+ */
+static bool forkScenario(const struct Scenario *sc, unsigned long ticks)
+{
+	int status;
+	pid_t pid = fork();
+
+	if (pid < 0)
+		return false;
+	if (pid == 0)
+	{
+		runScenario(sc, ticks);
+		exit(0);
+	}
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct Scenario sc = {0, 0, 0, 0};
+	unsigned long ticks = BENCH_TICKS;
+	bool single = false;
+	bool fixed_board;
+	bool ok = true;
+	unsigned int e, f, b;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+			ticks = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--enemies") == 0 && i + 1 < argc)
+		{
+			sc.enemies = strtoul(argv[++i], NULL, 10);
+			single = true;
+		}
+		else if (strcmp(argv[i], "--fire") == 0 && i + 1 < argc)
+		{
+			sc.fire_ticks = strtoul(argv[++i], NULL, 10);
+			single = true;
+		}
+		else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+			sc.rows = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cols") == 0 && i + 1 < argc)
+			sc.cols = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Usage: %s [--ticks N] [--enemies N] [--fire N] [--rows N] [--cols N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if ((sc.rows != 0 && (sc.rows < MIN_GAME_ROWS || sc.rows > MAX_GAME_ROWS))
+	    || (sc.cols != 0 && (sc.cols < MIN_GAME_COLS || sc.cols > MAX_GAME_COLS)))
+	{
+		fprintf(stderr, "Boards from %dx%d to %dx%d are supported\n",
+		        MIN_GAME_ROWS, MIN_GAME_COLS, MAX_GAME_ROWS, MAX_GAME_COLS);
+		return 1;
+	}
+
+	// A board given on the command line replaces the sizes of the matrix
+	fixed_board = sc.rows != 0 || sc.cols != 0;
+	if (sc.rows == 0)
+		sc.rows = MIN_GAME_ROWS;
+	if (sc.cols == 0)
+		sc.cols = MIN_GAME_COLS;
+
+	if (single)
+		return forkScenario(&sc, ticks) ? 0 : 1;
+
+	for (b = 0; b < (fixed_board ? 1 : sizeof(BOARD_SIZES) / sizeof(BOARD_SIZES[0])); b++)
+	{
+		if (!fixed_board)
+		{
+			sc.rows = BOARD_SIZES[b][0];
+			sc.cols = BOARD_SIZES[b][1];
+		}
+		for (e = 0; e < sizeof(ENEMY_COUNTS) / sizeof(ENEMY_COUNTS[0]); e++)
+		{
+			for (f = 0; f < sizeof(FIRE_TICKS) / sizeof(FIRE_TICKS[0]); f++)
+			{
+				sc.enemies = ENEMY_COUNTS[e];
+				sc.fire_ticks = FIRE_TICKS[f];
+				ok = forkScenario(&sc, ticks) && ok;
+			}
+		}
+	}
+	return ok ? 0 : 1;
+}
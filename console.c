@@ -3,47 +3,276 @@
   Author: Daniel Rea
 
   Purpose: see console.h
-  DO NOT MODIFY THIS CODE
-  In fact, you probably shouldn't be reading any of this, but it may be useful to see.
+  Started from the course console, since extended with cell buffers that
+  only send changed runs, a raw ANSI backend and a headless mode
 
-  NOTES: none
+  NOTES: curses cannot move its cursor past the bottom right cell, so a
+  run ending there returns ERR although it was drawn. Nothing is printed
+  while the screen is in use, other failed draws are reported on exit
 **********************************************************************/
 
 #include "console.h"
+#include "arena.h"
 #include <curses.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>        /*for nano sleep */
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
 
 
 static int CON_WIDTH, CON_HEIGHT;
 static int consoleLock = false;
-static int MAX_STR_LEN = 256; /* for strlen checking */
+static bool headless = false;   /* cells are kept in the buffers but never sent to curses */
+static int MAX_STR_LEN = 1024; /* for strlen checking */
+static struct Arena *arena = NULL; /* session arena the buffers come from */
+
+/* Cell buffers, one char per cell in row major order. Drawing only touches
+   the back buffer, front holds what the terminal shows since the last refresh */
+static char *frontBuf = NULL;
+static char *backBuf = NULL;
+static struct ConsoleStats stats;
+static unsigned long drawErrors = 0; /* failed draws, printed once the screen is restored */
+
+/* Columns drawn since the last refresh on each row, a row is clean when
+   dirtyLo >= dirtyHi. Dirty rows are also listed so a refresh only looks
+   at what was drawn and its cost does not grow with the console size */
+static int *dirtyLo = NULL;
+static int *dirtyHi = NULL;
+static int *dirtyRows = NULL;
+static int numDirty = 0;
+
+/* Unchanged cells shorter than this between two changed runs are re-sent
+   instead of starting a new run, one cursor move costs about as much */
+#define RUN_MERGE_GAP 4
+
+/* Raw ANSI backend, each frame is composed in outBuf and sent with one
+   write(2). The terminal mode curses would have set up is kept in
+   savedTermios so it can be put back */
+static bool ansi = false;
+static bool ansiActive = false;    /* terminal is in our mode */
+static char *outBuf = NULL;
+static int outLen, outCap;
+static int curRow = -1, curCol = -1;   /* where the terminal cursor is, -1 if unknown */
+static int termRows, termCols;
+static struct termios savedTermios;
+
+/* Longest cursor move, ESC [ row ; col H with up to 6 digits each */
+#define ANSI_MOVE_MAX 16
+
+/* Write counters of this thread when the console was set up */
+static unsigned long long ioBytes, ioWrites;
 
 /* Local functions */
 
-static bool checkConsoleSize(int reqHeight, int reqWidth) 
+/* Widens the dirty span of `row' to cover columns [left, right) */
+static void markDirty(int row, int left, int right)
 {
+	if (dirtyLo[row] >= dirtyHi[row])
+	{
+		dirtyRows[numDirty++] = row;
+		dirtyLo[row] = left;
+		dirtyHi[row] = right;
+		return;
+	}
+	if (left < dirtyLo[row])
+		dirtyLo[row] = left;
+	if (right > dirtyHi[row])
+		dirtyHi[row] = right;
+}
 
-	if ( (reqWidth > COLS) || (reqHeight > LINES) ) 
+static bool checkConsoleSize(int reqHeight, int reqWidth, int lines, int cols) 
+{
+
+	if ( (reqWidth > cols) || (reqHeight > lines) ) 
  	{
-    		fprintf(stderr, "\n\n\rSorry, your window is only %ix%i. \n\r%ix%i is required. Sorry.\n\r", COLS, LINES, reqWidth, reqHeight);
+    		fprintf(stderr, "\n\n\rSorry, your window is only %ix%i. \n\r%ix%i is required. Sorry.\n\r", cols, lines, reqWidth, reqHeight);
     		return (false);
   	}
 
   return(true);
 }
 
+/* Reads the bytes written and write calls made so far by the calling
+   thread, both are left at zero if the kernel does not keep them */
+static void readThreadIo(unsigned long long *bytes, unsigned long long *writes)
+{
+	char line[64];
+	FILE *f = fopen("/proc/thread-self/io", "r");
+
+	*bytes = *writes = 0;
+	if (f == NULL)
+		return;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		sscanf(line, "wchar: %llu", bytes);
+		sscanf(line, "syscw: %llu", writes);
+	}
+	fclose(f);
+}
+
+/* Sends the composed frame to the terminal, a short write is retried with
+   what is left so the frame is only split if the terminal makes us */
+static void ansiFlush(void)
+{
+	int done = 0, n;
+
+	while (done < outLen)
+	{
+		n = write(STDOUT_FILENO, outBuf + done, outLen - done);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		done += n;
+	}
+	outLen = 0;
+}
+
+/* Appends `v' in decimal, returns the digits written */
+static int ansiPutInt(char *p, int v)
+{
+	char digits[12];
+	int n = 0, i;
+
+	do
+	{
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v > 0);
+	for (i = 0; i < n; i++)
+		p[i] = digits[n - 1 - i];
+	return n;
+}
+
+/* Appends a run of text at `(row, col)', the cursor is only moved when it
+   is not there already. A frame too large for the buffer is flushed early */
+static void ansiPutRun(int row, int col, const char *text, int len)
+{
+	char *p;
+
+	if (outLen + ANSI_MOVE_MAX + len > outCap)
+		ansiFlush();
+
+	p = outBuf + outLen;
+	if (row != curRow || col != curCol)
+	{
+		*p++ = '\033';
+		*p++ = '[';
+		p += ansiPutInt(p, row + 1);
+		*p++ = ';';
+		p += ansiPutInt(p, col + 1);
+		*p++ = 'H';
+	}
+	memcpy(p, text, len);
+	outLen = p + len - outBuf;
+
+	/* the cursor stays put after writing the last column */
+	curRow = row;
+	curCol = col + len < termCols ? col + len : -1;
+}
+
+/* Puts the terminal in character mode without echo like curses crmode() and
+   noecho(), switches to the alternate screen, clears it and hides the cursor */
+static bool ansiInit(void)
+{
+	static const char enter[] = "\033[?1049h\033[H\033[2J\033[?25l";
+	struct winsize ws;
+	struct termios raw;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || tcgetattr(STDIN_FILENO, &savedTermios) < 0)
+	{
+		fprintf(stderr, "\n\rSorry, the output is not a terminal.\n\r");
+		return(false);
+	}
+	termRows = ws.ws_row;
+	termCols = ws.ws_col;
+	if (!checkConsoleSize(CON_HEIGHT, CON_WIDTH, termRows, termCols))
+		return(false);
+
+	/* worst case frame, every row in runs split by RUN_MERGE_GAP cells */
+	outCap = CON_HEIGHT * (CON_WIDTH + (CON_WIDTH / (RUN_MERGE_GAP + 1) + 1) * ANSI_MOVE_MAX) + ANSI_MOVE_MAX;
+	outBuf = arenaAlloc(arena, ARENA_SCREEN, outCap);
+	if (outBuf == NULL)
+		return(false);
+
+	raw = savedTermios;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+	ansiActive = true;
+
+	memcpy(outBuf, enter, sizeof(enter) - 1);
+	outLen = sizeof(enter) - 1;
+	ansiFlush();
+	curRow = curCol = -1;
+	return(true);
+}
+
+/* Shows the cursor, leaves the alternate screen and restores the terminal */
+static void ansiFinish(void)
+{
+	static const char leave[] = "\033[?25h\033[?1049l";
+
+	if (ansiActive)
+	{
+		if (write(STDOUT_FILENO, leave, sizeof(leave) - 1) < 0)
+			fprintf(stderr, "ERROR restoring the screen");
+		tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+		ansiActive = false;
+	}
+	outBuf = NULL;
+	outLen = outCap = 0;
+}
+
 bool consoleInit(int height, int width, char *image[])  /* assumes image height/width is same as height param */
 {
 	bool status;
-
-	initscr();
-	crmode();
-	noecho();
-	clear();
+	int i;
 
 	CON_HEIGHT = height;  CON_WIDTH = width;
-	status = checkConsoleSize(CON_HEIGHT, CON_WIDTH);
+
+	if (headless)
+		status = true;
+	else if (ansi)
+		status = ansiInit();
+	else
+	{
+		initscr();
+		crmode();
+		noecho();
+		clear();
+		status = checkConsoleSize(CON_HEIGHT, CON_WIDTH, LINES, COLS);
+	}
+
+	if (status)
+	{
+		frontBuf = arenaAlloc(arena, ARENA_SCREEN, CON_HEIGHT * CON_WIDTH);
+		backBuf = arenaAlloc(arena, ARENA_SCREEN, CON_HEIGHT * CON_WIDTH);
+		dirtyLo = arenaAlloc(arena, ARENA_SCREEN, CON_HEIGHT * sizeof(int));
+		dirtyHi = arenaAlloc(arena, ARENA_SCREEN, CON_HEIGHT * sizeof(int));
+		dirtyRows = arenaAlloc(arena, ARENA_SCREEN, CON_HEIGHT * sizeof(int));
+		if (frontBuf == NULL || backBuf == NULL || dirtyLo == NULL || dirtyHi == NULL || dirtyRows == NULL)
+			return(false);
+
+		/* screen was just cleared, both buffers start blank */
+		memset(frontBuf, ' ', CON_HEIGHT * CON_WIDTH);
+		memset(backBuf, ' ', CON_HEIGHT * CON_WIDTH);
+		memset(&stats, 0, sizeof(stats));
+		for (i = 0; i < CON_HEIGHT; i++)
+		{
+			dirtyLo[i] = CON_WIDTH;
+			dirtyHi[i] = 0;
+		}
+		numDirty = 0;
+		if (!headless)
+			readThreadIo(&ioBytes, &ioWrites);
+	}
 
 	if (status) 
 	{
@@ -57,7 +286,7 @@ bool consoleInit(int height, int width, char *image[])  /* assumes image height/
 void consoleDrawImage(int row, int col, char *image[], int height) 
 {
 	int i, length;
-	int newLeft, newRight, newOffset, newLength;
+	int newLeft, newRight, newOffset;
 
 	if (consoleLock) return;
 
@@ -69,19 +298,69 @@ void consoleDrawImage(int row, int col, char *image[], int height)
 		if (row+i < 0 || row+i >= CON_HEIGHT)
 			continue;
 		length = strnlen(image[i], MAX_STR_LEN);
-		newRight = col+length >= CON_WIDTH ? CON_WIDTH-1 : col+length;
-		newLength = newRight - newLeft + 1;
-		if (newOffset >= length || newLength <= 0)
+		newRight = col+length > CON_WIDTH ? CON_WIDTH : col+length;
+		if (newOffset >= length || newRight <= newLeft)
 		  continue;
 
-		if (mvaddnstr(row+i, newLeft, image[i]+newOffset, newLength) == ERR)
-			fprintf(stderr, "ERROR drawing to screen"); /* smarter handling is needed */
+		memcpy(backBuf + (row+i)*CON_WIDTH + newLeft, image[i]+newOffset, newRight - newLeft);
+		markDirty(row+i, newLeft, newRight);
+	}
+}
+
+bool consoleInitSprite(struct Sprite *s, char **rows, int frames, int height)
+{
+	int i;
+
+	if (frames * height > SPRITE_MAX_ROWS)
+		return(false);
+
+	s->frames = frames;
+	s->height = height;
+	s->width = 0;
+	s->rows = rows;
+	for (i = 0; i < frames * height; i++)
+	{
+		s->lengths[i] = strnlen(rows[i], MAX_STR_LEN);
+		if (s->lengths[i] > s->width)
+			s->width = s->lengths[i];
+	}
+	return(true);
+}
+
+void consoleDrawSprite(int row, int col, const struct Sprite *s, int frame)
+{
+	int i, first, last, right;
+	int left, offset;
+	char **image;
+	const int *lengths;
+
+	if (consoleLock) return;
+
+	/* rows and columns that fall on the console */
+	first = row < 0 ? -row : 0;
+	last = row + s->height > CON_HEIGHT ? CON_HEIGHT - row : s->height;
+	left = col < 0 ? 0 : col;
+	offset = left - col;
+	if (first >= last || left >= CON_WIDTH || col + s->width <= 0)
+		return;
+
+	image = s->rows + frame * s->height;
+	lengths = s->lengths + frame * s->height;
+
+	for (i = first; i < last; i++)
+	{
+		right = col + lengths[i] > CON_WIDTH ? CON_WIDTH : col + lengths[i];
+		if (right > left)
+		{
+			memcpy(backBuf + (row+i)*CON_WIDTH + left, image[i] + offset, right - left);
+			markDirty(row+i, left, right);
+		}
 	}
 }
 
 void consoleClearImage(int row, int col, int height, int width) 
 {
-	int i, j;
+	int i;
 	if (consoleLock) return;
 
 	if (col+width > CON_WIDTH)
@@ -99,24 +378,120 @@ void consoleClearImage(int row, int col, int height, int width)
 	{
 		if (row+i < 0 || row+i >= CON_HEIGHT)
 			continue;
-		move(row+i, col);
-		for (j = 0; j < width; j++)
-	    		addch(' ');
+		memset(backBuf + (row+i)*CON_WIDTH + col, ' ', width);
+		markDirty(row+i, col, col+width);
 	}
 }
 
+/* Sends the runs of cells that differ between back and front buffer to
+   curses, then makes the front buffer match the back buffer. Only the
+   dirty span of each dirty row is compared */
+static void flushChangedCells(void)
+{
+	int i, r, c, start, end, hi;
+	char *back, *front;
+
+	for (i = 0; i < numDirty; i++)
+	{
+		r = dirtyRows[i];
+		back = backBuf + r*CON_WIDTH;
+		front = frontBuf + r*CON_WIDTH;
+		c = dirtyLo[r];
+		hi = dirtyHi[r];
+		stats.scanned += hi - c;
+
+		while (c < hi)
+		{
+			if (back[c] == front[c])
+			{
+				c++;
+				continue;
+			}
+
+			/* extend the run over short stretches of unchanged cells */
+			start = c;
+			end = c + 1;
+			for (c = end; c < hi && c - end < RUN_MERGE_GAP; c++)
+				if (back[c] != front[c])
+					end = c + 1;
+
+			if (!headless && ansi)
+				ansiPutRun(r, start, back + start, end - start);
+			else if (!headless && mvaddnstr(r, start, back + start, end - start) == ERR
+			         && !(r == CON_HEIGHT - 1 && end == CON_WIDTH))
+				drawErrors++;
+			memcpy(front + start, back + start, end - start);
+
+			stats.cells += end - start;
+			stats.calls++;
+			c = end;
+		}
+
+		dirtyLo[r] = CON_WIDTH;
+		dirtyHi[r] = 0;
+	}
+	numDirty = 0;
+}
+
 void consoleRefresh(void)
 {
 	if (!consoleLock) 
 	{
-	    move(LINES-1, COLS-1);
-	    refresh();
+	    flushChangedCells();
+	    if (!headless && ansi)
+	      ansiFlush();
+	    else if (!headless)
+	    {
+	      move(LINES-1, COLS-1);
+	      refresh();
+	    }
+	    stats.frames++;
 	}
 }
 
+void consoleGetStats(struct ConsoleStats *out)
+{
+	*out = stats;
+}
+
+void consoleSetHeadless(bool enabled)
+{
+	headless = enabled;
+}
+
+void consoleSetAnsi(bool enabled)
+{
+	ansi = enabled;
+}
+
+void consoleSetArena(struct Arena *a)
+{
+	arena = a;
+}
+
 void consoleFinish(void) 
 {
-    endwin();
+    unsigned long long bytes, writes;
+
+    /* everything this thread wrote since the console was set up */
+    if (!headless && frontBuf != NULL)
+    {
+      readThreadIo(&bytes, &writes);
+      stats.bytes = bytes - ioBytes;
+      stats.writes = writes - ioWrites;
+    }
+
+    if (!headless && ansi)
+      ansiFinish();
+    else if (!headless)
+      endwin();
+    if (drawErrors > 0)
+      fprintf(stderr, "ERROR drawing to screen %lu times\n", drawErrors);
+    drawErrors = 0;
+    /* the buffers themselves go with the session arena */
+    frontBuf = backBuf = NULL;
+    dirtyLo = dirtyHi = dirtyRows = NULL;
+    numDirty = 0;
 }
 
 void putBanner(const char *str) 
@@ -125,9 +500,12 @@ void putBanner(const char *str)
   int len;
 
   len = strnlen(str,MAX_STR_LEN);
-  
-  move (CON_HEIGHT/2, (CON_WIDTH-len)/2);
-  addnstr(str, len);
+  if (len > CON_WIDTH)
+    len = CON_WIDTH;
+
+  memcpy(backBuf + (CON_HEIGHT/2)*CON_WIDTH + (CON_WIDTH-len)/2, str, len);
+  if (len > 0)
+    markDirty(CON_HEIGHT/2, (CON_WIDTH-len)/2, (CON_WIDTH-len)/2 + len);
 
   consoleRefresh();
 }
@@ -135,8 +513,16 @@ void putBanner(const char *str)
 void putString(char *str, int row, int col, int maxlen) 
 {
   if (consoleLock) return;
-  move(row, col);
-  addnstr(str, maxlen);
+  if (row < 0 || row >= CON_HEIGHT || col < 0 || col >= CON_WIDTH)
+    return;
+
+  int len = strnlen(str, maxlen);
+  if (col+len > CON_WIDTH)
+    len = CON_WIDTH-col;
+
+  memcpy(backBuf + row*CON_WIDTH + col, str, len);
+  if (len > 0)
+    markDirty(row, col, col+len);
 }
 
 
@@ -160,6 +546,14 @@ struct timespec getTimeout(int ticks)
   return rqtp;
 }
 
+unsigned long long getTimeNsec(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * TIME_USECS_SIZE * USEC_TO_NSEC + now.tv_nsec;
+}
+
 void sleepTicks(int ticks) 
 {
 
@@ -173,6 +567,20 @@ void sleepTicks(int ticks)
 #define FINAL_PAUSE 2 
 void finalKeypress() 
 {
+	char c;
+
+	if (headless)
+		return;
+
+	if (ansi)
+	{
+		tcflush(STDIN_FILENO, TCIFLUSH);
+		sleepTicks(FINAL_PAUSE);
+		if (read(STDIN_FILENO, &c, 1) < 0)
+			fprintf(stderr, "ERROR reading final key");
+		return;
+	}
+
 	flushinp();
 	sleepTicks(FINAL_PAUSE);
     	move(LINES-1, COLS-1);
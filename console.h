@@ -37,25 +37,79 @@ extern bool consoleInit(int reqHeight, int reqWidth, char *image[]);
    half off the screen  */
 extern void consoleDrawImage(int row, int col, char *image[], int height);
 
+/* Most rows a sprite can have over all of its frames */
+#define SPRITE_MAX_ROWS 32
+
+/* Sprite atlas, all frames of an animated image with the length of every
+   row worked out once, so drawing it needs no string scans */
+struct Sprite
+{
+	int frames;                       /* number of frames */
+	int height;                       /* rows in each frame */
+	int width;                        /* longest row of any frame */
+	char **rows;                      /* frames*height rows, frame after frame */
+	int lengths[SPRITE_MAX_ROWS];     /* length of each row */
+};
+
+/* Fills in sprite `s' from `frames' images of `height' rows laid out one after
+   the other in `rows', such as a 2d array of strings. The strings must outlive
+   the sprite. Returns false if the sprite has more than SPRITE_MAX_ROWS rows */
+extern bool consoleInitSprite(struct Sprite *s, char **rows, int frames, int height);
+
+/* Draws `frame' of sprite `s' at curses coordinates `(row, col)', clipped
+   like consoleDrawImage() but with integer math only */
+extern void consoleDrawSprite(int row, int col, const struct Sprite *s, int frame);
+
 /* Clears a 2d `width'x`height' rectangle with spaces.  Upper left hand
    corner is curses coordinate `(row,col)'. */
 extern void consoleClearImage(int row, int col, int height, int width);
 
-/* Moves cursor to bottom right corner and refreshes. If this is not done,
-   the curses internal buffer (that you have been drawing to) is not dumped
-   to screen. */
+/* Sends the cells changed since the last refresh to curses, moves cursor
+   to bottom right corner and refreshes. If this is not done, the back
+   buffer (that you have been drawing to) is not dumped to screen. */
 extern void consoleRefresh(void);
 
+/* Counters of the work done by consoleRefresh() since consoleInit(). The
+   terminal output is what the thread running the console wrote, as the
+   kernel counts it, and is only filled in by consoleFinish() */
+struct ConsoleStats
+{
+	unsigned long frames;   /* number of refreshes */
+	unsigned long cells;    /* cells handed to curses */
+	unsigned long scanned;  /* cells compared to find them */
+	unsigned long calls;    /* curses draw calls made */
+	unsigned long long bytes;   /* bytes written to the terminal */
+	unsigned long long writes;  /* write calls made for them */
+};
+
+/* Copies the current refresh counters into `out' */
+extern void consoleGetStats(struct ConsoleStats *out);
+
 /*  turns off all updates. Can be used to prevent the screen refresh from working, e.g., at game end while threads are all catching up.*/
 extern void disableConsole(int disabled);
 
+/* Selects the null renderer, must be called before consoleInit(). Drawing still
+   updates the cell buffers but curses is never started, so no terminal is needed
+   and finalKeypress() returns straight away. */
+extern void consoleSetHeadless(bool enabled);
+
+/* Selects the raw ANSI backend in place of curses, must be called before
+   consoleInit(). Each refresh composes cursor moves and the changed cells
+   into one buffer and sends it with a single write(2) */
+extern void consoleSetAnsi(bool enabled);
+
+/* Selects the session arena the cell and output buffers are allocated from,
+   must be called before consoleInit(). The buffers go when the arena is reset */
+struct Arena;
+extern void consoleSetArena(struct Arena *a);
+
 /* Terminates curses cleanly. */
 extern void consoleFinish(void);
 
 /* Puts the given banner in the center of the screen */
 void putBanner(const char *);
 
-/* Draws the given string at the given location  */
+/* Draws the given string at the given location, clipped to the console  */
 void putString(char *, int row, int col, int maxlen);
 
 /* Sleeps the given number of 20ms ticks */
@@ -67,4 +121,7 @@ void finalKeypress();
 /* gets a timespec that represents the time of one tick */
 struct timespec getTimeout(int ticks);
 
+/* gets the monotonic clock time in nanoseconds, for measuring durations */
+unsigned long long getTimeNsec(void);
+
 #endif /* CONSOLE_H */
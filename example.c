@@ -1,51 +1,23 @@
 
 #include "console.h"
 #include "example.h"
-
-
-// Global variables 
-struct Player player;			// Holds player info
-struct Bullet *bhead;			// Linked list head of all bullets 
-struct Enemy *ehead;			// Linked list head of all enemy/caterpillar
-enum GAME_STATUS game_status;	// Variable to store game status
-
-// Variables storing threads
-pthread_t stat_thread;			// Thread to print score and lives info	
-pthread_t keyboard_thread;		// Thread to handle keypress
-pthread_t upkeep_thread;		// Thread that rountinely deletes dead bullets and their thread  
-pthread_t enemy_gen_thread;		// Thread that generates enemy/caterpillar
-
-// Global mutex locks
-pthread_mutex_t bullet_list_lock;	// Lock to be acquired for modifying bullet linked list
-pthread_mutex_t game_board_lock;	// Lock to be acquired for modifying enemy linked list
-pthread_mutex_t enemy_list_lock;	// Lock to be acquired for updating game board
-
-// Initial game board Look
-char *GAME_BOARD[] = {
-	"                Score:                                    Lives:               ",
-	"=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-centipiede!=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	"",
-	""};
+#include "threadpool.h"
+#include "timerwheel.h"
+#include "lockstat.h"
+#include "spawnqueue.h"
+#include "render.h"
+#include "inputlog.h"
+#include "arena.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sched.h>
+#include <errno.h>
+
+
+// Bullet representations shared by all bullets
+char *BULLET_UP_ANIM[1] = {"'"};
+char *BULLET_DOWN_ANIM[1] = {"v"};
 
 // 3D array that holds all player animations
 char *PLAYER_ANIMATIONS[P_ANIMS][P_HEIGHT] =
@@ -75,634 +47,1937 @@ char *PLAYER_ANIMATIONS[P_ANIMS][P_HEIGHT] =
 		 "(O)",
 		 "/|\\"}};
 	
-// 3D array that holds all enemy animation while moving towards left
+// 3D arrays that hold the animations of a segment leading a run
+// of a caterpillar and of a segment following it, while moving towards left
+char *ENEMY_HEAD_LEFT[E_ANIMS][E_HEIGHT] =
+	{
+		{"X|||",
+		 "=;;;"},
+		{"C||^",
+		 "=;;,"},
+		{"X|^|",
+		 "=;,;"},
+		{"C^||",
+		 "=,;;"}};
+
 char *ENEMY_BODY_LEFT[E_ANIMS][E_HEIGHT] =
 	{
-		{"X|||^|||^|||^|||^|||^|||^|||^|||^",
-		 "=;;;,;;;,;;;,;;;,;;;,;;;,;;;,;;;,"},
-		{"C||^|||^|||^|||^|||^|||^|||^|||^|",
-		 "=;;,;;;,;;;,;;;,;;;,;;;,;;;,;;;,;"},
-		{"X|^|||^|||^|||^|||^|||^|||^|||^||",
-		 "=;,;;;,;;;,;;;,;;;,;;;,;;;,;;;,;;"},
-		{"C^|||^|||^|||^|||^|||^|||^|||^|||",
-		 "=,;;;,;;;,;;;,;;;,;;;,;;;,;;;,;;;"}};
+		{"^|||",
+		 ",;;;"},
+		{"|||^",
+		 ";;;,"},
+		{"||^|",
+		 ";;,;"},
+		{"|^||",
+		 ";,;;"}};
+
+// 3D arrays that hold the same animations while moving toward right
+char *ENEMY_HEAD_RIGHT[E_ANIMS][E_HEIGHT] =
+	{
+		{"|||X",
+		 ";;;="},
+		{"^||C",
+		 ",;;="},
+		{"|^|X",
+		 ";,;="},
+		{"||^C",
+		 ";;,="}};
 
-// 3D array that holds all enemy animation while moving toward right
 char *ENEMY_BODY_RIGHT[E_ANIMS][E_HEIGHT] =
 	{
-		{"^|||^|||^|||^|||^|||^|||^|||^|||X",
-		 ",;;;,;;;,;;;,;;;,;;;,;;;,;;;,;;;="},
-		{"|^|||^|||^|||^|||^|||^|||^|||^||C",
-		 ";,;;;,;;;,;;;,;;;,;;;,;;;,;;;,;;="},
-		{"||^|||^|||^|||^|||^|||^|||^|||^|X",
-		 ";;,;;;,;;;,;;;,;;;,;;;,;;;,;;;,;;="},
-		{"|||^|||^|||^|||^|||^|||^|||^|||^C",
-		 ";;;,;;;,;;;,;;;,;;;,;;;,;;;,;;;,="}};
+		{"|||^",
+		 ";;;,"},
+		{"^|||",
+		 ",;;;"},
+		{"|^||",
+		 ";,;;"},
+		{"||^|",
+		 ";;,;"}};
+
+// Sprite atlases of the images above, built once by initSprites()
+struct Sprite bullet_up_sprite;
+struct Sprite bullet_down_sprite;
+struct Sprite player_sprite;
+struct Sprite enemy_head_left_sprite;
+struct Sprite enemy_body_left_sprite;
+struct Sprite enemy_head_right_sprite;
+struct Sprite enemy_body_right_sprite;
+
+// The game exampleRun() plays, its arena is kept for the next run
+static struct Game main_game;
+
+volatile sig_atomic_t latency_dump_requested;	// Set by SIGUSR1
+
+// Sprites are measured by the first game that starts
+static pthread_once_t sprites_once = PTHREAD_ONCE_INIT;
 
 /**
  * Driver function that does the following
  *  Initialize the console game board with specified dimension
- *  Initialize global variables, mutex locks and player info
+ *  Initialize the game state, mutex locks and player info
  * 	Start the game threads with corresponnding function
  *  Wait for threads to finish
  *  Destory all locks and release dynamically alloted memory
  *  Print exit message and wait for final key press
  */
-void exampleRun()
+void exampleRun(const struct GameOptions *opts, struct GameReport *report)
 {
-	if (consoleInit(GAME_ROWS, GAME_COLS, GAME_BOARD))
-	{ 
-		srand(time(NULL));		// Seed the pseudo randomizer
-		initPlayer();			// Initialize player info
-		initLocks();			// Initialize all mutex locks
+	struct Game *game = &main_game;
+	unsigned long long start_ns, run_ns = 0, shutdown_ns = 0;
+	struct RenderStats render_stats;
+
+	if (report != NULL)
+		memset(report, 0, sizeof(*report));
 
-		bhead = NULL;			// Initally no bullets exist
-		ehead = NULL;			// Initally no enemy exist
-		game_status = Running;	// Change game status to running
+	if (!prepareGame(game, opts, ARENA_RESERVE))
+	{
+		if (report != NULL)
+			report->status = Error;
+		return;
+	}
+	opts = game->options;
 
-		// Intialize threads refer to each function defintion for their purpose
-		pthread_create(&stat_thread, NULL, updateScoreScreenThreadFun, NULL);
-		pthread_create(&keyboard_thread, NULL, keyboardThreadFun, NULL);
-		pthread_create(&player.anim_thread, NULL, playerAnimationThreadFun, NULL);
-		pthread_create(&upkeep_thread, NULL, bulletUpkeepThreadFun, NULL);
-		pthread_create(&enemy_gen_thread, NULL, enemyGenThreadFun, NULL);
+	// The render thread owns the console from here on
+	consoleSetAnsi(opts->ansi);
+	if (!renderInit(game->board.rows, game->board.cols, game->board_image, opts->headless, &game->session))
+	{
+		closeInputLog(game, 0);
+		freeSession(game);
+		if (report != NULL)
+			report->status = Error;
+		return;
+	}
 
-		// Join all threads
-		pthread_join(keyboard_thread, NULL);
-		pthread_cancel(upkeep_thread); 			// Cancelling these two thread due to their
-		pthread_cancel(enemy_gen_thread);		// long sleep times delay exit from program
-		pthread_join(stat_thread, NULL);
-		pthread_join(player.anim_thread, NULL);
-		pthread_join(upkeep_thread, NULL);
-		pthread_join(enemy_gen_thread, NULL);
+	startGame(game);
+	game->draws = true;
+	if (!poolInit(&game->workers, 0, &game->session))	// One worker per core
+	{
+		renderBanner("Error occured while running!!");
+		renderFinish();
+		closeInputLog(game, 0);
+		destroyLocks(game);
+		freeSession(game);
+		if (report != NULL)
+			report->status = Error;
+		return;
+	}
+	game->use_workers = true;
+	signal(SIGUSR1, dumpLatency);	// kill -USR1 writes latency so far
 
-		// Destroy Locks and release memory 
-		destroyLocks();
-		deleteAllBullets();
-		deleteAllEnemy();
-		
-		// Print Exit message
-		printGameExit();
-		finalKeypress(); /* wait for final key before killing curses and game */
+	// Every sleeping thread wakes up on this event when the game ends
+	game->shutdown_fd = eventfd(0, 0);
+	if (game->shutdown_fd < 0)
+		endGame(game, Error);
+
+	// A soak log goes to stderr unless the terminal shows the game
+	game->soaking = opts->soak_log != NULL || (opts->autoplay && opts->headless);
+	if (game->soaking && !soakOpen(&game->soak_log, opts->soak_log, opts->soak_secs, getTimeNsec()))
+	{
+		game->soaking = false;
+		endGame(game, Error);
+	}
+	if (opts->autoplay && opts->autoplay_secs > 0)
+		game->autoplay_end_ns = getTimeNsec() + opts->autoplay_secs * 1000000000ULL;
+
+	// Register periodic game activities on the timer wheel
+	initTimers(game);
+
+	start_ns = getTimeNsec();
+
+	// Intialize threads refer to each function defintion for their purpose
+	// A headless game has no keyboard and does not wait for tick deadlines
+	if (opts->headless)
+	{
+		pthread_create(&game->sim_thread, NULL, headlessThreadFun, game);
+		pthread_join(game->sim_thread, NULL);
+	}
+	else
+	{
+		pthread_create(&game->keyboard_thread, NULL, keyboardThreadFun, game);
+		pthread_create(&game->sim_thread, NULL, simulationThreadFun, game);
+
+		// Join all threads
+		pthread_join(game->keyboard_thread, NULL);
+		pthread_join(game->sim_thread, NULL);
 	}
-	consoleFinish();
+	run_ns = getTimeNsec() - start_ns;
+	closeInputLog(game, game->wheel.now);
+	if (game->soaking)
+		soakClose(&game->soak_log);
+
+	// Destroy Locks and release memory 
+	poolDestroy(&game->workers);
+	game->use_workers = false;
+	deleteAllEnemy(game);
+	destroyLocks(game);
+	if (game->shutdown_fd >= 0)
+		close(game->shutdown_fd);
+	shutdown_ns = getTimeNsec() - game->ended_ns;
+	
+	// Print Exit message once the last frame of the game is on screen
+	renderSync();
+	printGameExit(game);
+
+	// Waits for final key before killing curses
+	renderFinish();
 
+	if (report != NULL)
+		gameGetReport(game, report);
+	freeSession(game);
+
+	if (report != NULL)
+	{
+		renderGetStats(&render_stats);
+		report->shutdown_ns = shutdown_ns;
+		report->run_ns = run_ns;
+		report->render_ns = render_stats.render_ns;
+		report->frames = render_stats.frames;
+		report->render_stalls = render_stats.stalls;
+		report->cells = render_stats.cells;
+		report->scanned = render_stats.scanned;
+		report->bytes = render_stats.bytes;
+		report->writes = render_stats.writes;
+		report->frame_time = render_stats.frame_time;
+		report->input_latency = render_stats.input_latency;
+	}
 }
 
 /**
- * Function that initializes global mutex locks
+ * Function that creates a game for a library caller. The game is
+ * headless, draws nothing and runs its enemies on the calling
+ * thread, so each game is stepped by one thread at a time and
+ * games on different threads share nothing they write
  */
-void initLocks()
+struct Game *gameCreate(const struct GameOptions *opts)
 {
-	pthread_mutex_init(&game_board_lock, NULL);
-	pthread_mutex_init(&player.player_lock, NULL);
-	pthread_mutex_init(&bullet_list_lock, NULL);
-	pthread_mutex_init(&enemy_list_lock, NULL);
+	struct GameOptions played = *opts;
+	struct Game *game = calloc(1, sizeof(struct Game));
+
+	if (game == NULL)
+		return NULL;
+
+	// The game never draws and has no workers, its arena only holds the board
+	played.headless = true;
+	if (!prepareGame(game, &played, 0))
+	{
+		arenaDestroy(&game->session);
+		free(game);
+		return NULL;
+	}
+	startGame(game);
+	if (played.autoplay && played.autoplay_secs > 0)
+		game->autoplay_end_ns = getTimeNsec() + played.autoplay_secs * 1000000000ULL;
+	initTimers(game);
+	return game;
 }
 
 /**
- * Function that destroys global mutex lockss
+ * Function that runs one tick of a game after pressing the key of
+ * action, ending the game at its tick limit or at the end of its replay
  */
-void destroyLocks()
+enum GAME_STATUS gameStep(struct Game *game, enum GameAction action)
 {
-	pthread_mutex_destroy(&game_board_lock);
-	pthread_mutex_destroy(&player.player_lock);
-	pthread_mutex_destroy(&bullet_list_lock);
-	pthread_mutex_destroy(&enemy_list_lock);
+	const struct GameOptions *opts = game->options;
+
+	// Runs stop at the tick limit or where the replayed recording ended
+	if ((opts->max_ticks > 0 && game->wheel.now >= opts->max_ticks) || replayOver(game))
+		endGame(game, Quit);
+	if (gameStatus(game) != Running)
+		return gameStatus(game);
+
+	if (action != ACTION_NONE)
+		handleKey(game, action, getTimeNsec());
+	wheelStep(&game->wheel);
+	return gameStatus(game);
 }
 
 /**
- * Initialize player info
+ * Function that reports how a game went so far, render numbers are
+ * left at zero since only exampleRun() draws its game
  */
-void initPlayer()
+void gameGetReport(struct Game *game, struct GameReport *report)
 {
-	player.score = 0;
-	player.lives = 3;
-	player.anim_count = 0;
-	player.pos_c = P_START_COL;
-	player.pos_r = P_START_ROW;
+	struct PlayerView view;
+
+	memset(report, 0, sizeof(*report));
+	readPlayer(game, &view);
+	report->status = gameStatus(game);
+	report->seed = game->options->seed;
+	report->rows = game->board.rows;
+	report->cols = game->board.cols;
+	report->ticks = game->wheel.now;
+	report->missed = game->wheel.missed;
+	report->spawns_dropped = game->spawns.dropped;
+	report->score = view.score;
+	report->lives = view.lives;
+	arenaGetStats(&game->session, &report->memory);
 }
 
 /**
- * Function that prints how the game came to an end
+ * Function that releases a game made by gameCreate()
  */
-void printGameExit()
+void gameDestroy(struct Game *game)
 {
-	if (game_status == Quit)
-		putBanner("Quitting Game!");
-	else if (game_status == Lost)
-		putBanner("You Lost. Better Luck Next Time");
-	else if (game_status == Won)
-		putBanner("Congrats You Won!!");
-	else if (game_status == Error)
-		putBanner("Error occured while running!!");
-
+	closeInputLog(game, game->wheel.now);
+	deleteAllEnemy(game);
+	destroyLocks(game);
+	arenaDestroy(&game->session);
+	free(game);
 }
 
 /**
- * Function that spawns enemy at random but regular intervals
+ * Helper function that settles the options of a game, opens its
+ * input log and builds its board in the arena of the game. The
+ * arena reserves reserve bytes, or just what the board takes if
+ * reserve is 0
  */
-void *enemyGenThreadFun()
+bool prepareGame(struct Game *game, const struct GameOptions *opts, size_t reserve)
 {
-	// Initialize a timer to count interval between enemy spawns
-	unsigned int t = 1;
-
-	while (game_status == Running)
+	// A replayed game takes its seed, board and settings from the log
+	game->played_options = *opts;
+	pickBoardSize(&game->played_options);
+	if (!openInputLog(game, &game->played_options))
 	{
-		t--;
-		if (t > 0)
-		{
-			sleepTicks(ENEMY_GEN_TICKS);
-			continue;
-		}
-		// Generate new enemy only when timer hits zero
-		// Then re initialize the timer
-		t = 3 + rand()%7;
-
-		// Acquire the lock to prevent modification by another thread
-		pthread_mutex_lock(&enemy_list_lock);
+		fprintf(stderr, "Could not open input log %s\n", opts->replay ? opts->replay : opts->record);
+		return false;
+	}
+	game->options = &game->played_options;
 
-		// Allocate memory for new enemy
-		struct Enemy *temp = (struct Enemy *) malloc(sizeof(struct Enemy));
-		
-		if(temp == NULL)
-		{
-			game_status = Error;
-			return NULL;
-		}
+	// The arena is reserved by the first game and kept for the next ones
+	if (reserve == 0)
+		reserve = boardReserve(game->options->rows, game->options->cols);
+	if (game->session.base == NULL && !arenaInit(&game->session, reserve))
+	{
+		closeInputLog(game, 0);
+		return false;
+	}
 
-		// Intialize data for new enemy 
-		temp->pos_c = GAME_COLS - 1;
-		temp->pos_r = 2;
-		temp->anim_count = 0;
-		temp->next = ehead;
-		temp->direct = LEFT;
-		ehead = temp;
-		
-		// Release the lock
-		pthread_mutex_unlock(&enemy_list_lock);
-
-		// Create new thread that simulates the enemy movement and animation
-		pthread_create(&temp->enemy_thread, NULL, enemyAnimationThreadFun, (void *)temp);
-		sleepTicks(ENEMY_GEN_TICKS);
+	// Lay the zones out on the board and build what it looks like
+	layoutBoard(game, game->options->rows, game->options->cols);
+	if (!buildBoardImage(game))
+	{
+		closeInputLog(game, 0);
+		freeSession(game);
+		return false;
 	}
-	return NULL;
+	return true;
 }
 
 /**
- * Function that releases memory and threads of dead bullets
- * at a regular interval
+ * Helper function that puts a prepared game at its first tick with
+ * the player at its start and no bullets or caterpillars. The game
+ * has no shutdown event, soak log or worker pool until its caller
+ * gives it one
  */
-void *bulletUpkeepThreadFun()
+void startGame(struct Game *game)
 {
-	struct Bullet *curr;
-	struct Bullet *prev;
+	// Seed the pseudo randomizer, random_r() then gives what rand() would
+	memset(&game->rng, 0, sizeof(game->rng));
+	initstate_r(game->options->seed, game->rng_state, sizeof(game->rng_state), &game->rng);
+
+	pthread_once(&sprites_once, initSprites);	// Measure every sprite once
+	initPlayer(game);			// Initialize player info
+	initLocks(game);			// Initialize all mutex locks
+	initBulletPool(game);		// Initially no bullets exist
+	game->num_segments = 0;		// Initially no enemy exist
+	game->live_segments = 0;
+	game->enemies_requested = 0;
+	game->enemies_spawned = 0;
+	spawnQueueInit(&game->spawns);
+	initGrid(game);				// Initially only the player is on the board
+	memset(&game->input_queue, 0, sizeof(game->input_queue));
+	game->hud_drawn = false;	// Score and lives are drawn on the first frame
+	game->draws = false;
+	game->last_frame_slot = 0;
+	game->use_workers = false;
+	game->shutdown_fd = -1;
+	game->soaking = false;
+	game->autoplay_end_ns = 0;
+	__atomic_store_n(&game->game_status, Running, __ATOMIC_RELEASE);	// Change game status to running
+}
 
-	while (game_status == Running)
-	{
-		// If zero bullets exist go back to sleep
-		if (bhead == NULL)
-		{
-			sleepTicks(UPKEEP_INT_TICKS);
-			continue;
-		}
+/**
+ * Helper function that draws the next number of the pseudo randomizer
+ * of the game, only the simulation thread draws from it
+ */
+int gameRand(struct Game *game)
+{
+	int32_t r;
 
-		// Acquire linked list lock for bullets to prevent external modification
-		pthread_mutex_lock(&bullet_list_lock);
+	random_r(&game->rng, &r);
+	return r;
+}
 
-		// Update head until head is live
-		while (bhead != NULL && !bhead->is_live)
-		{
-			curr = bhead;
-			bhead = bhead->next;
-			// join thread and release thread memory
-			pthread_join(curr->bullet_thread, NULL);
-			// Free bullet representation string
-			free(curr->anim[0]);
-			// free bullet memory
-			free(curr);
-		}
+/**
+ * Function that starts the timer wheel and registers the
+ * periodic callbacks of the game at their tick rates
+ */
+void initTimers(struct Game *game)
+{
+	struct timespec tick = getTimeout(1);
+
+	wheelInit(&game->wheel, tick.tv_sec * 1000000000L + tick.tv_nsec);
+	wheelAdd(&game->wheel, &game->refresh_timer, refreshScreen, game, 1, 1);
+	wheelAdd(&game->wheel, &game->player_anim_timer, animatePlayer, game, 1, PLAYER_ANIM_TICKS);
+	wheelAdd(&game->wheel, &game->enemy_gen_timer, spawnEnemy, game, 1, 0);
+	wheelAdd(&game->wheel, &game->spawn_timer, drainSpawns, game, 1, 1);
+	wheelAdd(&game->wheel, &game->bullet_timer, updateAllBullets, game, BULLET_MOV_TICKS, BULLET_MOV_TICKS);
+	wheelAdd(&game->wheel, &game->enemy_timer, updateAllEnemies, game, ENEMY_MOV_TICKS, ENEMY_MOV_TICKS);
+
+	// The bot presses keys between two frames, the next frame applies them
+	if (game->options->autoplay)
+		wheelAdd(&game->wheel, &game->autoplay_timer, autoplayStep, game, 1, INPUT_TICKS);
+	if (game->soaking)
+		wheelAdd(&game->wheel, &game->soak_timer, soakCheck, game, 1, 1);
+}
 
-		curr = bhead;
-		prev = NULL;
+/**
+ * Helper function that settles the board size. Sizes not given fit
+ * the terminal, or the smallest board when headless, and every size
+ * is kept between the smallest and largest board. A terminal smaller
+ * than the smallest board is turned down by the console
+*/
+void pickBoardSize(struct GameOptions *played)
+{
+	struct winsize ws;
 
-		// Iterate through remaining bullets and do the same
-		while (curr != NULL)
-		{
-			if (!curr->is_live)
-			{
-				prev->next = curr->next;
-				pthread_join(curr->bullet_thread, NULL);
-				free(curr->anim[0]);
-				free(curr);
-			}
-			else
-				prev = curr;
+	if ((played->rows <= 0 || played->cols <= 0) && !played->headless
+	    && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+	{
+		if (played->rows <= 0)
+			played->rows = ws.ws_row;
+		if (played->cols <= 0)
+			played->cols = ws.ws_col;
+	}
 
-			curr = prev->next;
-		}
+	if (played->rows < MIN_GAME_ROWS)
+		played->rows = MIN_GAME_ROWS;
+	if (played->rows > MAX_GAME_ROWS)
+		played->rows = MAX_GAME_ROWS;
+	if (played->cols < MIN_GAME_COLS)
+		played->cols = MIN_GAME_COLS;
+	if (played->cols > MAX_GAME_COLS)
+		played->cols = MAX_GAME_COLS;
+}
 
-		// Release the lock
-		pthread_mutex_unlock(&bullet_list_lock);
-		sleepTicks(UPKEEP_INT_TICKS);
-	}
-	return NULL;
+/**
+ * Helper function that lays the zones out on a board of the given size.
+ * The fence keeps its place at 14 of the 22 rows below the title, lanes
+ * are E_HEIGHT rows apart from LANE_TOP down to the fence and the player
+ * starts near the bottom in the middle. A 24x80 board gets the fence on
+ * row 16, lanes down to row 14 and the player at row 20 column 40
+*/
+void layoutBoard(struct Game *game, int rows, int cols)
+{
+	game->board.rows = rows;
+	game->board.cols = cols;
+	game->board.fence_row = LANE_TOP + (rows - LANE_TOP) * 14 / 22;
+	game->board.lane_bottom = LANE_TOP + (game->board.fence_row - E_HEIGHT - LANE_TOP) / E_HEIGHT * E_HEIGHT;
+	game->board.player_top = game->board.fence_row + 1;
+	game->board.start_row = rows - P_HEIGHT - 1;
+	game->board.start_col = cols / 2;
 }
 
 /**
- * Function to print updated score and lives to the screen
- */
-void *updateScoreScreenThreadFun()
+ * Helper function that builds the look of the board, the score and
+ * lives labels, the title line and the fence, and allocates the
+ * collision grid. Returns false if memory runs out
+*/
+bool buildBoardImage(struct Game *game)
 {
-	// String to hold update score and lives
-	unsigned int t = SCORE_UPDATE_TICKS;
-	char score_lives[GAME_COLS];
-	while (game_status == Running)
-	{
-		t--;
-		if(t != 0)
-		{
-			consoleRefresh();
-			sleepTicks(SCREEN_REFRESH_TICKS);
-		}
-		t = SCORE_UPDATE_TICKS;
+	const char *title = "centipiede!";
+	int len = strlen(title);
+	char *score, *line, *fence;
+	int r, c;
+
+	game->board_image = arenaAlloc(&game->session, ARENA_BOARD, game->board.rows * sizeof(char *));
+	game->board_text = arenaAlloc(&game->session, ARENA_BOARD, 3 * (game->board.cols + 1));
+	game->grid = arenaAlloc(&game->session, ARENA_GRID, game->board.rows * game->board.cols * sizeof(struct Cell));
+	if (game->board_image == NULL || game->board_text == NULL || game->grid == NULL)
+		return false;
+
+	score = game->board_text;
+	line = score + game->board.cols + 1;
+	fence = line + game->board.cols + 1;
+
+	memset(score, ' ', game->board.cols);
+	memcpy(score + SCORE_COL, "Score:", 6);
+	memcpy(score + game->board.cols - LIVES_COL_FROM_RIGHT, "Lives:", 6);
+	for (c = 0; c < game->board.cols; c++)
+		line[c] = c % 2 == 0 ? '=' : '-';
+	memcpy(line + (game->board.cols - len) / 2, title, len);
+	memset(fence, '"', game->board.cols);
+	score[game->board.cols] = line[game->board.cols] = fence[game->board.cols] = '\0';
+
+	for (r = 0; r < game->board.rows; r++)
+		game->board_image[r] = "";
+	game->board_image[0] = score;
+	game->board_image[1] = line;
+	game->board_image[game->board.fence_row] = fence;
+	return true;
+}
 
-		// Store updated score to string
-		snprintf(score_lives, GAME_COLS, "                Score: %-4u                               Lives: %-4u", player.score, player.lives);
-		// Print updated string to screen
-		pthread_mutex_lock(&game_board_lock);
-		putString(score_lives, 0, 0, GAME_COLS);
-		consoleRefresh();
-		pthread_mutex_unlock(&game_board_lock);
-		sleepTicks(SCREEN_REFRESH_TICKS);
-	}
-	return NULL;
+/**
+ * Helper function that tells how many arena bytes buildBoardImage()
+ * takes for a board, alignment included
+ */
+size_t boardReserve(int rows, int cols)
+{
+	return rows * sizeof(char *) + 3 * (cols + 1) + rows * cols * sizeof(struct Cell) + 3 * ARENA_ALIGN;
 }
 
 /**
- * Function that changes player animation every 40 ticks
+ * Helper function that releases everything the game allocated in one step,
+ * the board look, the collision grid, the console buffers, the render
+ * rings and the workers all go with the session arena
 */
-void *playerAnimationThreadFun()
+void freeSession(struct Game *game)
 {
-	char **player_body;
+	arenaReset(&game->session);
+	game->board_image = NULL;
+	game->board_text = NULL;
+	game->grid = NULL;
+}
 
-	while (game_status == Running)
-	{
-		// Acquire player locak to prevent external modification
-		pthread_mutex_lock(&player.player_lock);
+/**
+ * Helper function that returns the collision cell at a position on the board
+*/
+struct Cell *cellAt(struct Game *game, int r, int c)
+{
+	return &game->grid[r * game->board.cols + c];
+}
 
-		player_body = PLAYER_ANIMATIONS[player.anim_count];		// Get player body as 2D array
-		player.anim_count = (player.anim_count + 1) % P_ANIMS;	// Update animation counter 
+/**
+ * Function that builds the sprite atlases from the static images
+ */
+void initSprites()
+{
+	consoleInitSprite(&bullet_up_sprite, BULLET_UP_ANIM, 1, 1);
+	consoleInitSprite(&bullet_down_sprite, BULLET_DOWN_ANIM, 1, 1);
+	consoleInitSprite(&player_sprite, &PLAYER_ANIMATIONS[0][0], P_ANIMS, P_HEIGHT);
+	consoleInitSprite(&enemy_head_left_sprite, &ENEMY_HEAD_LEFT[0][0], E_ANIMS, E_HEIGHT);
+	consoleInitSprite(&enemy_body_left_sprite, &ENEMY_BODY_LEFT[0][0], E_ANIMS, E_HEIGHT);
+	consoleInitSprite(&enemy_head_right_sprite, &ENEMY_HEAD_RIGHT[0][0], E_ANIMS, E_HEIGHT);
+	consoleInitSprite(&enemy_body_right_sprite, &ENEMY_BODY_RIGHT[0][0], E_ANIMS, E_HEIGHT);
+}
 
-		// Acquire board lock to print to screen
-		pthread_mutex_lock(&game_board_lock);
+/**
+ * Function that initializes the mutex locks of the game
+ */
+void initLocks(struct Game *game)
+{
+	pthread_mutex_init(&game->bullet_list_lock, NULL);
+	pthread_mutex_init(&game->enemy_list_lock, NULL);
+}
 
-		consoleClearImage(player.pos_r, player.pos_c, P_HEIGHT, P_LENGTH);
-		consoleDrawImage(player.pos_r, player.pos_c, player_body, P_HEIGHT);
+/**
+ * Function that destroys the mutex locks of the game
+ */
+void destroyLocks(struct Game *game)
+{
+	pthread_mutex_destroy(&game->bullet_list_lock);
+	pthread_mutex_destroy(&game->enemy_list_lock);
+}
 
-		// Release locks
-		pthread_mutex_unlock(&game_board_lock);
-		pthread_mutex_unlock(&player.player_lock);
-		
-		sleepTicks(PLAYER_ANIM_TICKS);
-	}
-	return NULL;
+/**
+ * Initialize player info
+ */
+void initPlayer(struct Game *game)
+{
+	game->player.seq = 0;
+	game->player.score = 0;
+	game->player.lives = 3;
+	game->player.anim_count = 0;
+	game->player.pos_c = game->board.start_col;
+	game->player.pos_r = game->board.start_row;
 }
 
 /**
- * Function that handles bullet simulation
+ * Helper functions that bracket every change to the player. The
+ * sequence is odd while a change is under way and moves on once it is
+ * done, so a reader that saw it odd or moved knows to read again. The
+ * simulation thread is the only writer and never waits for a reader
 */
-void *bulletAnimationThreadFun(void *arg)
+static void beginPlayerWrite(struct Game *game)
 {
-	struct Bullet *temp = (struct Bullet *)arg;
-	temp->is_live = true;	// Mark the bullet as live as it's fired
-	int r;					// To store old row number of bullet
+	__atomic_store_n(&game->player.seq, game->player.seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
-	while (game_status == Running && temp->is_live)
-	{
-		// store current bullet row
-		r = temp->pos_r;
+static void endPlayerWrite(struct Game *game)
+{
+	__atomic_store_n(&game->player.seq, game->player.seq + 1, __ATOMIC_RELEASE);
+}
 
-		// Update bullet position according to the direction
-		if (temp->direct == UP)		
-			temp->pos_r--;
-		else
-			temp->pos_r++;
+/**
+ * Function that copies the player without ever holding up the simulation,
+ * the copy is taken again if the player changed while it was being taken
+*/
+void readPlayer(struct Game *game, struct PlayerView *out)
+{
+	unsigned int seq;
 
-		// Check if bullet moves out of bounds if yes exit from the loop
-		if (temp->pos_r > 23 || temp->pos_r < 2)
+	while (true)
+	{
+		seq = __atomic_load_n(&game->player.seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
 		{
-			consoleClearImage(r, temp->pos_c, 1, 1);
-			break;
+			// Let the writer finish if it was preempted mid change
+			sched_yield();
+			continue;
 		}
-		
-		// Update bullet position on screen
-		pthread_mutex_lock(&game_board_lock);
-		consoleClearImage(r, temp->pos_c, 1, 1);
-		consoleDrawImage(temp->pos_r, temp->pos_c, temp->anim, 1);
-		pthread_mutex_unlock(&game_board_lock);
-
-		sleepTicks(BULLET_MOV_TICKS);
-	}
 
-	temp->is_live = false;
+		out->pos_r = __atomic_load_n(&game->player.pos_r, __ATOMIC_RELAXED);
+		out->pos_c = __atomic_load_n(&game->player.pos_c, __ATOMIC_RELAXED);
+		out->lives = __atomic_load_n(&game->player.lives, __ATOMIC_RELAXED);
+		out->score = __atomic_load_n(&game->player.score, __ATOMIC_RELAXED);
+		out->anim_count = __atomic_load_n(&game->player.anim_count, __ATOMIC_RELAXED);
 
-	return NULL;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&game->player.seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
 }
 
 /**
- * Function that simulates enemy 
+ * Helper functions that change the player, run by the simulation thread
 */
-void *enemyAnimationThreadFun(void *arg)
+void setPlayerPos(struct Game *game, int row, int col)
 {
-	struct Enemy *temp = (struct Enemy *)arg;
-
-	// Stores time interval between bullet fire by enemy
-	int t = 3 + (rand() % 11);
+	beginPlayerWrite(game);
+	__atomic_store_n(&game->player.pos_r, row, __ATOMIC_RELAXED);
+	__atomic_store_n(&game->player.pos_c, col, __ATOMIC_RELAXED);
+	endPlayerWrite(game);
+}
 
-	// Stores row and column for wrap around part of enemy
-	int w_r = 2;
-	int w_c = 0;
+void setPlayerAnim(struct Game *game, unsigned int anim_count)
+{
+	beginPlayerWrite(game);
+	__atomic_store_n(&game->player.anim_count, anim_count, __ATOMIC_RELAXED);
+	endPlayerWrite(game);
+}
 
-	// To store 2D representation of enemy
-	char **curr = NULL;
-	char **wrap = NULL;
+void addPlayerScore(struct Game *game, unsigned int points)
+{
+	beginPlayerWrite(game);
+	__atomic_store_n(&game->player.score, game->player.score + points, __ATOMIC_RELAXED);
+	endPlayerWrite(game);
+}
 
-	while (game_status == Running)
-	{
-		pthread_mutex_lock(&game_board_lock);
+void takePlayerLife(struct Game *game)
+{
+	if (game->player.lives == 0)
+		return;
+	beginPlayerWrite(game);
+	__atomic_store_n(&game->player.lives, game->player.lives - 1, __ATOMIC_RELAXED);
+	endPlayerWrite(game);
+}
 
-		// If enemy is moving towards left
-		if (temp->direct == LEFT)
-		{
-			// clear current position of caterpillar
-			consoleClearImage(temp->pos_r, temp->pos_c, E_HEIGHT, E_LENGTH);
-			// clear wrap around part if any
-			if ((w_c >= GAME_COLS) && (w_c < (GAME_COLS + E_LENGTH)))
-				consoleClearImage(w_r, w_c - E_LENGTH, E_HEIGHT, E_LENGTH);
-		}
+/**
+ * Function that prints how the game came to an end
+ */
+void printGameExit(struct Game *game)
+{
+	enum GAME_STATUS status = gameStatus(game);
 
-		// If enemy is moving towards right
-		if (temp->direct == RIGHT)
-		{
-			consoleClearImage(temp->pos_r, temp->pos_c - E_LENGTH, E_HEIGHT, E_LENGTH);
-			if ((w_c < 0) && (w_c > (-1*E_LENGTH)))
-				consoleClearImage(w_r, w_c, E_HEIGHT, E_LENGTH);
-		}
+	if (status == Quit)
+		renderBanner("Quitting Game!");
+	else if (status == Lost)
+		renderBanner("You Lost. Better Luck Next Time");
+	else if (status == Won)
+		renderBanner("Congrats You Won!!");
+	else if (status == Error)
+		renderBanner("Error occured while running!!");
 
-		// Update the enemy position and the wrap around part if any
-		updateEnemyPos(temp, &w_r, &w_c);	
+}
 
-		
-		if (temp->direct == LEFT)
-		{
-			// Get new 2D representation of enemy and it's wrap around part
-			curr = ENEMY_BODY_LEFT[temp->anim_count];
-			wrap = ENEMY_BODY_RIGHT[temp->anim_count];
-			// Draw the enemy to screen
-			consoleDrawImage(temp->pos_r, temp->pos_c, curr, E_HEIGHT);
-			// Draw wrap around part of enemy to screen 
-			// Taking advantage of passing negative column which draws only partial image
-			if ((w_c >= GAME_COLS) && (w_c < (GAME_COLS + E_LENGTH)))
-				consoleDrawImage(w_r, w_c - E_LENGTH, wrap, E_HEIGHT);
-		}
+/**
+ * Helper function that reads the game status, safe from any thread
+*/
+enum GAME_STATUS gameStatus(struct Game *game)
+{
+	return __atomic_load_n(&game->game_status, __ATOMIC_ACQUIRE);
+}
 
-		if (temp->direct == RIGHT)
-		{
-			curr = ENEMY_BODY_RIGHT[temp->anim_count];
-			wrap = ENEMY_BODY_LEFT[temp->anim_count];
-			consoleDrawImage(temp->pos_r, temp->pos_c - E_LENGTH, curr, E_HEIGHT);
-			if ((w_c < 0) && (w_c > (-1 * E_LENGTH)))
-				consoleDrawImage(w_r, w_c, wrap, E_HEIGHT);
-		}
+/**
+ * Helper function that ends a running game with the given status and
+ * wakes every thread sleeping on the shutdown event. Only the first
+ * call has an effect, returns whether it was this one
+*/
+bool endGame(struct Game *game, enum GAME_STATUS status)
+{
+	enum GAME_STATUS running = Running;
 
-		pthread_mutex_unlock(&game_board_lock);
+	if (!__atomic_compare_exchange_n(&game->game_status, &running, status, false,
+	                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return false;
 
-		// Decrease the time interval to fire the bullet
-		t--;
+	game->ended_ns = getTimeNsec();
+	if (game->shutdown_fd >= 0)
+		eventfd_write(game->shutdown_fd, 1);
+	return true;
+}
 
-		// If interval hits zero fire a bullet and re initialize time
-		if (t == 0)
-		{
-			createInsertBullet(DOWN, temp->pos_r + 1, temp->pos_c);
-			t = 3 + (rand() % 11);
-		}
+/**
+ * Function that drives the simulation loop, runs the timer
+ * wheel so every game activity fires at its own tick rate
+*/
+void *simulationThreadFun(void *arg)
+{
+	struct Game *game = arg;
+	// The wheel stops sleeping as soon as the game ends
+	wheelSetStopEvent(&game->wheel, game->shutdown_fd);
 
-		// If caterpillar reaches end of screen game is lost
-		if (temp->pos_r > 14)
+	while (gameStatus(game) == Running)
+	{
+		if (replayOver(game))
 		{
-			game_status = Lost;
+			endGame(game, Quit);
 			break;
 		}
-
-		sleepTicks(ENEMY_MOV_TICKS);
+		wheelRunTick(&game->wheel);
 	}
 	return NULL;
 }
 
 /**
- * Function to handle key presses
-*/
-void *keyboardThreadFun()
+ * Timer callback that asks for an enemy and re-arms itself
+ * so enemies spawn at random but regular intervals
+ */
+void spawnEnemy(void *arg)
 {
-	// Using code from template
-	fd_set set;
-	while (game_status == Running)
-	{
-		// Initialize set to zero
-		FD_ZERO(&set);
-		// Watch for input on stdin
-		FD_SET(STDIN_FILENO, &set);
+	struct Game *game = arg;
+	struct SpawnRequest req = {SPAWN_ENEMY, LANE_TOP, game->board.cols - 1, LEFT};
 
-		struct timespec timeout = getTimeout(1);
-		int ret = pselect(FD_SETSIZE, &set, NULL, NULL, &timeout, NULL);
-		// ret will be non-zero if 
-		if (game_status == Running && ret >= 1)
-		{
-			char c = getchar();
+	// The whole wave has been asked for
+	if (game->enemies_requested >= game->options->enemies)
+		return;
 
-			// Move player if W, A, S or D is pressed
-			if (c == MOVE_LEFT && player.pos_c > 0)
-			{
-				movePlayer(player.pos_r, player.pos_c--);
-			}
-			else if (c == MOVE_RIGHT && player.pos_c < GAME_COLS - P_LENGTH)
-			{
-				movePlayer(player.pos_r, player.pos_c++);
-			}
-			else if (c == MOVE_DOWN && player.pos_r < GAME_ROWS - P_HEIGHT)
-			{
-				movePlayer(player.pos_r++, player.pos_c);
-			}
-			else if (c == MOVE_UP && player.pos_r > 17)
-			{
-				movePlayer(player.pos_r--, player.pos_c);
-			}
+	// A full queue is tried again with the next enemy
+	if (spawnQueuePush(&game->spawns, &req))
+		game->enemies_requested++;
 
-			// Fire a plyer bullet is space is pressed
-			else if (c == SHOOT)
-			{
-				player.score++;
-				createInsertBullet(UP, player.pos_r - 1, player.pos_c + 1);
-			}
-			
-			// Change the game status to quit if q is pressed
-			else if (c == QUIT)
+	// Schedule the next enemy
+	if (game->options->spawn_ticks > 0)
+		wheelAdd(&game->wheel, &game->enemy_gen_timer, spawnEnemy, game, game->options->spawn_ticks, 0);
+	else
+		wheelAdd(&game->wheel, &game->enemy_gen_timer, spawnEnemy, game, (3 + gameRand(game) % 7) * ENEMY_GEN_TICKS, 0);
+}
+
+/**
+ * Timer callback that spawns everything asked for since the last tick,
+ * bullets are inserted in a fixed order under a single hold of the pool lock
+ */
+void drainSpawns(void *arg)
+{
+	struct Game *game = arg;
+	struct SpawnRequest req;
+	struct SpawnRequest fired[SPAWN_QUEUE_SIZE];
+	int num_fired = 0;
+	int i;
+
+	while (num_fired < SPAWN_QUEUE_SIZE && spawnQueuePop(&game->spawns, &req))
+	{
+		if (req.kind == SPAWN_ENEMY)
+		{
+			// A full segment array gives the caterpillar back to the
+			// generator, which asks for it again later
+			if (!insertEnemy(game))
 			{
-				game_status = Quit;
+				game->enemies_requested--;
+				if (!game->enemy_gen_timer.active)
+					wheelAdd(&game->wheel, &game->enemy_gen_timer, spawnEnemy, game, ENEMY_GEN_TICKS, 0);
 			}
-			sleepTicks(SCREEN_REFRESH_TICKS);
 		}
+		else
+			fired[num_fired++] = req;
 	}
-	return NULL;
+	if (num_fired == 0)
+		return;
+
+	// Workers push their shots in whatever order they finish, sorting them
+	// gives every bullet the same pool slot each time a game is replayed
+	qsort(fired, num_fired, sizeof(fired[0]), compareSpawns);
+
+	lockMutex(&game->bullet_list_lock);
+	for (i = 0; i < num_fired; i++)
+		insertBullet(game, fired[i].direct, fired[i].row, fired[i].col);
+	unlockMutex(&game->bullet_list_lock);
 }
 
 /**
- * Helper function that calculates new coordinates for enemy
- * and it's wrap wround part is any.
-*/
-void updateEnemyPos(struct Enemy *e, int *r, int *c)
+ * Helper function that orders spawn requests by
+ * position and then direction, for qsort()
+ */
+int compareSpawns(const void *a, const void *b)
 {
-	// Change the animation to next one
-	e->anim_count = (e->anim_count + 1) % E_ANIMS;
+	const struct SpawnRequest *x = a;
+	const struct SpawnRequest *y = b;
+
+	if (x->row != y->row)
+		return x->row - y->row;
+	if (x->col != y->col)
+		return x->col - y->col;
+	return (int)x->direct - (int)y->direct;
+}
 
-	// Change col value for enemy and wrap around part if any
-	if (e->direct == LEFT)
-	{	
-		e->pos_c--;
-		(*c) += 1;
-	}
-	else
+/**
+ * Helper function that adds a caterpillar as a block of E_SEGMENTS
+ * segments lined up off the right edge of the top row, all moving left.
+ * Blocks of caterpillars that were shot entirely are used again.
+ * Returns false if every segment is taken by a live caterpillar
+ */
+bool insertEnemy(struct Game *game)
+{
+	int first, s;
+
+	// Acquire the lock to prevent modification by another thread
+	lockMutex(&game->enemy_list_lock);
+
+	first = game->num_segments;
+	if (first + E_SEGMENTS > MAX_SEGMENTS)
+		first = findDeadBlock(game);
+	if (first < 0)
 	{
-		e->pos_c++;
-		(*c) -= 1;
+		unlockMutex(&game->enemy_list_lock);
+		return false;
 	}
 
-	// If reached end while going left or right
-	// Start moving to the opposite direction on next line
-	// Reset the wrap around part accordingly
-	if (e->pos_c < 0)
+	// Intialize data for new segments
+	for (s = first; s < first + E_SEGMENTS; s++)
 	{
-		(*r) = e->pos_r;
-		(*c) = e->pos_c;
-
-		e->pos_c = 0;
-		e->pos_r += 2;
-		e->direct = RIGHT;
+		game->segments.pos_r[s] = LANE_TOP;
+		game->segments.pos_c[s] = game->board.cols - 1 + (s - first) * E_SEG_LENGTH;
+		game->segments.direct[s] = LEFT;
+		game->segments.anim_count[s] = 0;
+		game->segments.seed[s] = gameRand(game);
+		game->segments.fire_timer[s] = 3 + (rand_r(&game->segments.seed[s]) % 11);
+		game->segments.is_live[s] = true;
+		game->segments.drawn[s] = false;
 	}
-	if (e->pos_c >= GAME_COLS)
-	{
-		(*r) = e->pos_r;
-		(*c) = e->pos_c;
 
-		e->pos_c = GAME_COLS - 1;
-		e->pos_r += 2;
-		e->direct = LEFT;
+	if (first == game->num_segments)
+		game->num_segments += E_SEGMENTS;
+	game->live_segments += E_SEGMENTS;
+	game->enemies_spawned++;
+	
+	// Release the lock
+	unlockMutex(&game->enemy_list_lock);
+	return true;
+}
+
+/**
+ * Helper function that returns the first segment of a caterpillar whose
+ * segments are all shot and cleared, -1 if there is none.
+ * Caller must hold enemy_list_lock
+ */
+int findDeadBlock(struct Game *game)
+{
+	int first, i;
+
+	for (first = 0; first < game->num_segments; first += E_SEGMENTS)
+	{
+		for (i = first; i < first + E_SEGMENTS; i++)
+			if (game->segments.is_live[i] || game->segments.drawn[i])
+				break;
+		if (i == first + E_SEGMENTS)
+			return first;
 	}
+	return -1;
 }
 
 /**
- * Helper function that joins all bullet threads and 
- * releases dynamically allocated memoy for them
-*/
-void deleteAllBullets()
+ * Helper function that prints score and lives to the screen,
+ * each only when it differs from what is shown already
+ */
+void updateHud(struct Game *game)
 {
-	if (bhead == NULL)
-		return;
+	// String to hold update score or lives
+	char text[32];
+	struct PlayerView view;
 
-	//acquire lock
-	pthread_mutex_lock(&bullet_list_lock);
-	struct Bullet *curr;
+	readPlayer(game, &view);
 
-	while (bhead != NULL)
+	// Print updated score and lives where the board has their labels
+	if (!game->hud_drawn || view.score != game->hud_score)
+	{
+		game->hud_score = view.score;
+		snprintf(text, sizeof(text), "Score: %-4u", game->hud_score);
+		renderString(text, 0, SCORE_COL, sizeof(text));
+	}
+	if (!game->hud_drawn || view.lives != game->hud_lives)
 	{
-		curr = bhead;
-		bhead = bhead->next;
-		pthread_join(curr->bullet_thread, NULL);
-		free(curr->anim[0]); 	// Free bullet 2D representation
-		free(curr);
+		game->hud_lives = view.lives;
+		snprintf(text, sizeof(text), "Lives: %-4u", game->hud_lives);
+		renderString(text, 0, game->board.cols - LIVES_COL_FROM_RIGHT, sizeof(text));
 	}
-	//release lock
-	pthread_mutex_unlock(&bullet_list_lock);
+	game->hud_drawn = true;
 }
 
 /**
- * Helper function that joins all enemy threads and
- * releases the dynamically allocated memory
-*/
-void deleteAllEnemy()
+ * Timer callback that runs every tick, applies the keys read every
+ * INPUT_TICKS and ends a frame when something on screen changed. The
+ * frame rate cap splits a second into max_fps slots with at most one
+ * frame each, a changed frame waits for the next slot. The render
+ * thread dumps the frame to the terminal without holding up the game
+ */
+void refreshScreen(void *arg)
 {
-	if (ehead == NULL)
+	struct Game *game = arg;
+	unsigned long slot = game->wheel.now * game->options->max_fps / TICKS_PER_SEC;
+
+	// Take the keys read since the last time
+	if (game->wheel.now % INPUT_TICKS == 0)
+		applyInput(game);
+
+	if (!game->draws)
 		return;
 
-	pthread_mutex_lock(&enemy_list_lock);
-	struct Enemy *curr;
+	updateHud(game);
+	if ((game->options->max_fps == 0 || slot != game->last_frame_slot) && renderPresent())
+		game->last_frame_slot = slot;
 
-	while (ehead != NULL)
-	{
-		curr = ehead;
-		ehead = ehead->next;
-		pthread_join(curr->enemy_thread, NULL);
-		free(curr);
-	}
-	pthread_mutex_unlock(&enemy_list_lock);
+	if (__atomic_exchange_n(&latency_dump_requested, 0, __ATOMIC_RELAXED))
+		renderDumpLatency();
 }
 
 /**
- * Helper function that changes player position 
- * according to key press
+ * Signal handler that asks the simulation thread
+ * to have the latency histogram written on its next refresh
 */
-void movePlayer(int old_row, int old_col)
+void dumpLatency(int sig)
 {
-	// Acquire player and game board lock
-	pthread_mutex_lock(&player.player_lock);
-	pthread_mutex_lock(&game_board_lock);
-	
-	// Get player animation 
-	char **player_body = PLAYER_ANIMATIONS[player.anim_count];
+	int saved_errno = errno;
 
-	// Clear old player position and redraw at new one
-	consoleClearImage(old_row, old_col, P_HEIGHT, P_LENGTH);
-	consoleDrawImage(player.pos_r, player.pos_c, player_body, P_HEIGHT);
-	
-	//Release the locks
-	pthread_mutex_unlock(&game_board_lock);
-	pthread_mutex_unlock(&player.player_lock);
+	__atomic_store_n(&latency_dump_requested, 1, __ATOMIC_RELAXED);
+	errno = saved_errno;
 }
 
 /**
- * Helper function that spawns a new bullet thread
- * in the direction and at position provided
+ * Timer callback that changes player animation every 40 ticks
 */
-void createInsertBullet(enum Direction d, int r, int c)
+void animatePlayer(void *arg)
 {
-	// Acquire bulllet list lock
-	pthread_mutex_lock(&bullet_list_lock);
-	struct Bullet *temp = (struct Bullet *) malloc(sizeof(struct Bullet));
+	struct Game *game = arg;
+	unsigned int frame = game->player.anim_count;			// Get player animation frame
 
-	if(temp == NULL)
-	{
-		game_status = Error;
+	setPlayerAnim(game, (frame + 1) % P_ANIMS);			// Update animation counter 
+
+	if (!game->draws)
 		return;
-	}
+	renderClearImage(game->player.pos_r, game->player.pos_c, P_HEIGHT, P_LENGTH);
+	renderDrawSprite(game->player.pos_r, game->player.pos_c, &player_sprite, frame);
+}
+
+/**
+ * Function run by a worker for a batch of up to SEGMENT_BATCH consecutive
+ * segments, moves every live one and decides whether the leaders of runs
+ * fire. Drawing is left to updateAllEnemies()
+*/
+void updateEnemyTask(void *arg)
+{
+	struct EnemyBatch *batch = arg;
+	struct Game *game = batch->game;
+	int first = batch->first;
+	int last = first + SEGMENT_BATCH;
+	int s;
 
-	//Acquire player lock to ensure player does not moves
-	temp->pos_c = c;
-	temp->pos_r = r;
-	temp->direct = d;
+	if (last > game->num_segments)
+		last = game->num_segments;
 
-	// Generate 2D representation of a bullet 
-	if (temp->direct == UP)
-		temp->anim[0] = strdup("'");
-	else
-		temp->anim[0] = strdup("v");
+	for (s = first; s < last; s++)
+	{
+		if (!game->segments.is_live[s])
+			continue;
 
-	temp->next = bhead;
-	bhead = temp;
+		// Update the segment position
+		updateSegmentPos(game, s);
 
-	// Release the lock
-	pthread_mutex_unlock(&bullet_list_lock);
+		// Every run fires on its own, from the segment leading it
+		// If interval hits zero fire a bullet and re initialize time
+		// Leaders still coming in from off the board hold their fire
+		if (isRunLeader(game, s) && --game->segments.fire_timer[s] <= 0 && game->segments.pos_c[s] < game->board.cols)
+		{
+			createInsertBullet(game, DOWN, game->segments.pos_r[s] + 1, game->segments.pos_c[s]);
+			game->segments.fire_timer[s] = 3 + (rand_r(&game->segments.seed[s]) % 11);
+		}
+
+		// If caterpillar reaches end of screen game is lost
+		// An endless game sends it back to the top instead
+		if (game->segments.pos_r[s] > game->board.lane_bottom)
+		{
+			if (game->options->endless)
+				game->segments.pos_r[s] = LANE_TOP;
+			else
+				endGame(game, Lost);
+		}
+	}
+}
+
+/**
+ * Timer callback that moves all segments in one pass over the segment
+ * array, split in batches on the worker pool, then redraws all of them
+ * in one batch from this thread
+*/
+void updateAllEnemies(void *arg)
+{
+	struct Game *game = arg;
+	struct EnemyBatch *batch;
+	int s;
+
+	// Keep the generator from adding segments during the pass
+	lockMutex(&game->enemy_list_lock);
+
+	// A game without workers moves its batches on this thread
+	for (s = 0; s < game->num_segments; s += SEGMENT_BATCH)
+	{
+		batch = &game->enemy_batches[s / SEGMENT_BATCH];
+		batch->game = game;
+		batch->first = s;
+		if (game->use_workers)
+			poolSubmit(&game->workers, updateEnemyTask, batch);
+		else
+			updateEnemyTask(batch);
+	}
+	if (game->use_workers)
+		poolWait(&game->workers);
+
+	// Clear every segment before drawing any so they do not erase each other
+	// Drawing may run a segment into a player bullet which needs the pool
+	lockMutex(&game->bullet_list_lock);
+	for (s = 0; s < game->num_segments; s++)
+		clearSegment(game, s);
+	for (s = 0; s < game->num_segments; s++)
+		if (game->segments.is_live[s])
+			drawSegment(game, s);
+	reapDeadSegments(game);
+	unlockMutex(&game->bullet_list_lock);
+
+	unlockMutex(&game->enemy_list_lock);
+}
+
+/**
+ * Helper function that tells whether a live segment leads a run, that is
+ * whether it is the first of its caterpillar or the segment ahead was shot
+*/
+bool isRunLeader(struct Game *game, int s)
+{
+	return s % E_SEGMENTS == 0 || !game->segments.is_live[s - 1];
+}
+
+/**
+ * Helper function that returns the leftmost column covered by a
+ * segment, the leading column is on the side it is moving to
+*/
+int segmentCol(int c, enum Direction d)
+{
+	return d == LEFT ? c : c - E_SEG_LENGTH + 1;
+}
+
+/**
+ * Helper function that clears a segment from where it was
+ * last drawn, from the screen and from the grid.
+ * Run by the simulation thread, which owns the grid
+*/
+void clearSegment(struct Game *game, int s)
+{
+	int col;
+
+	if (!game->segments.drawn[s])
+		return;
+
+	col = segmentCol(game->segments.drawn_c[s], game->segments.drawn_direct[s]);
+	if (game->draws)
+		renderClearImage(game->segments.drawn_r[s], col, E_HEIGHT, E_SEG_LENGTH);
+	unmarkSegment(game, s, game->segments.drawn_r[s], col);
+	game->segments.drawn[s] = false;
+}
+
+/**
+ * Helper function that draws a live segment at its current position,
+ * with a head if it leads its run, and marks it on the grid.
+ * Caller must hold bullet_list_lock
+*/
+void drawSegment(struct Game *game, int s)
+{
+	const struct Sprite *sprite;
+	int col = segmentCol(game->segments.pos_c[s], game->segments.direct[s]);
+
+	if (game->segments.direct[s] == LEFT)
+		sprite = isRunLeader(game, s) ? &enemy_head_left_sprite : &enemy_body_left_sprite;
+	else
+		sprite = isRunLeader(game, s) ? &enemy_head_right_sprite : &enemy_body_right_sprite;
+
+	if (game->draws)
+		renderDrawSprite(game->segments.pos_r[s], col, sprite, game->segments.anim_count[s]);
+	markSegment(game, s, game->segments.pos_r[s], col);
+
+	// Remember what was drawn so the next pass can clear it
+	game->segments.drawn[s] = true;
+	game->segments.drawn_r[s] = game->segments.pos_r[s];
+	game->segments.drawn_c[s] = game->segments.pos_c[s];
+	game->segments.drawn_direct[s] = game->segments.direct[s];
+}
+
+/**
+ * Helper function that empties the collision grid
+ * and marks the player at its start position
+*/
+void initGrid(struct Game *game)
+{
+	int r, c;
+
+	for (r = 0; r < game->board.rows; r++)
+	{
+		for (c = 0; c < game->board.cols; c++)
+		{
+			cellAt(game, r, c)->segment = -1;
+			cellAt(game, r, c)->bullet = -1;
+			cellAt(game, r, c)->player = false;
+		}
+	}
+	markPlayer(game, game->player.pos_r, game->player.pos_c, true);
+}
+
+/**
+ * Helper function that marks the cells of a segment as taken by it.
+ * A player bullet already sitting in one of them hits the segment.
+ * Caller must hold bullet_list_lock
+*/
+void markSegment(struct Game *game, int s, int row, int col)
+{
+	int r, c, b;
+
+	for (r = row; r < row + E_HEIGHT; r++)
+	{
+		for (c = col; c < col + E_SEG_LENGTH; c++)
+		{
+			if (r < 0 || r >= game->board.rows || c < 0 || c >= game->board.cols)
+				continue;
+			cellAt(game, r, c)->segment = s;
+
+			b = cellAt(game, r, c)->bullet;
+			if (b >= 0 && game->bullets.direct[b] == UP)
+			{
+				removeBullet(game, b);
+				hitSegment(game, s);
+			}
+		}
+	}
+}
+
+/**
+ * Helper function that frees the cells of a segment,
+ * cells since taken over by another segment are left alone.
+ * Run by the simulation thread, which owns the grid
+*/
+void unmarkSegment(struct Game *game, int s, int row, int col)
+{
+	int r, c;
+
+	for (r = row; r < row + E_HEIGHT; r++)
+	{
+		for (c = col; c < col + E_SEG_LENGTH; c++)
+		{
+			if (r < 0 || r >= game->board.rows || c < 0 || c >= game->board.cols)
+				continue;
+			if (cellAt(game, r, c)->segment == s)
+				cellAt(game, r, c)->segment = -1;
+		}
+	}
+}
+
+/**
+ * Helper function that sets or clears the player cells on the grid
+ * with the player at row and col, returns whether an enemy bullet
+ * is sitting in one of the cells. Run by the simulation thread
+*/
+bool markPlayer(struct Game *game, int row, int col, bool set)
+{
+	int r, c, b;
+	bool hit = false;
+
+	for (r = row; r < row + P_HEIGHT; r++)
+	{
+		for (c = col; c < col + P_LENGTH; c++)
+		{
+			cellAt(game, r, c)->player = set;
+			b = cellAt(game, r, c)->bullet;
+			if (set && b >= 0 && game->bullets.direct[b] == DOWN)
+				hit = true;
+		}
+	}
+	return hit;
+}
+
+/**
+ * Helper function that scores a hit on a segment, splitting its run in two
+ * without moving anything, the segment behind it now leads a run of its own.
+ * The segment is only flagged here and cleared later by reapDeadSegments()
+*/
+void hitSegment(struct Game *game, int s)
+{
+	int next = s + 1;
+
+	if (!game->segments.is_live[s])
+		return;
+	game->segments.is_live[s] = false;
+	game->live_segments--;
+	addPlayerScore(game, SEGMENT_KILL_SCORE);
+
+	// The new leader starts its own fire interval
+	if (next % E_SEGMENTS != 0 && next < game->num_segments && game->segments.is_live[next])
+		game->segments.fire_timer[next] = 3 + (rand_r(&game->segments.seed[next]) % 11);
+}
+
+/**
+ * Helper function that clears every segment that was hit,
+ * the game is won once the whole wave is generated and killed.
+ * Caller must hold enemy_list_lock
+*/
+void reapDeadSegments(struct Game *game)
+{
+	int s;
+
+	for (s = 0; s < game->num_segments; s++)
+		if (!game->segments.is_live[s] && game->segments.drawn[s])
+			clearSegment(game, s);
+
+	if (game->live_segments == 0 && game->enemies_spawned >= game->options->enemies
+	    && gameStatus(game) == Running && !game->options->endless)
+		endGame(game, Won);
+}
+
+/**
+ * Helper function that takes a life from the player and kills every
+ * bullet so the player does not die again straight away.
+ * Caller must hold bullet_list_lock
+*/
+void hitPlayer(struct Game *game)
+{
+	int b;
+
+	for (b = 0; b < game->bullets.high_water; b++)
+		if (game->bullets.is_live[b])
+			removeBullet(game, b);
+
+	takePlayerLife(game);
+	if (game->player.lives == 0 && gameStatus(game) == Running && !game->options->endless)
+		endGame(game, Lost);
+}
+
+/**
+ * Function to handle key presses, sleeps on stdin and the wake event
+ * with no timeout and takes every waiting byte with a single read
+*/
+void *keyboardThreadFun(void *arg)
+{
+	struct Game *game = arg;
+	struct epoll_event ev, events[2];
+	char keys[INPUT_READ_SIZE];
+	unsigned long long read_ns;
+	int epfd, n, i, k, len;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+	{
+		endGame(game, Error);
+		return NULL;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = STDIN_FILENO;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) < 0)
+		endGame(game, Error);
+	ev.data.fd = game->shutdown_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, game->shutdown_fd, &ev) < 0)
+		endGame(game, Error);
+
+	while (gameStatus(game) == Running)
+	{
+		n = epoll_wait(epfd, events, 2, -1);
+		read_ns = getTimeNsec();
+
+		for (i = 0; i < n && gameStatus(game) == Running; i++)
+		{
+			// The shutdown event only means the game is over
+			if (events[i].data.fd != STDIN_FILENO)
+				continue;
+
+			len = read(STDIN_FILENO, keys, sizeof(keys));
+			if (len == 0)
+				endGame(game, Quit);		// Terminal went away
+			for (k = 0; k < len; k++)
+			{
+				// The bot feeds the keys of the game, q still quits
+				if (game->options->autoplay && keys[k] != QUIT)
+					continue;
+				handleKey(game, keys[k], read_ns);
+			}
+		}
+	}
+
+	close(epfd);
+	return NULL;
+}
+
+/**
+ * Function that drives a headless game, runs the timer wheel as fast
+ * as possible and feeds the input script in place of the keyboard
+*/
+void *headlessThreadFun(void *arg)
+{
+	struct Game *game = arg;
+	const char *script = game->options->script;
+	const char *next_key = script;
+	enum GameAction action;
+
+	while (gameStatus(game) == Running)
+	{
+		// Feed the next scripted key, starting over at the end of the script
+		action = ACTION_NONE;
+		if (next_key != NULL && *next_key != '\0' && game->wheel.now % game->options->script_ticks == 0)
+		{
+			action = *next_key++;
+			if (*next_key == '\0')
+				next_key = script;
+		}
+		gameStep(game, action);
+	}
+	return NULL;
+}
+
+/**
+ * Helper function that returns how many keys of a kind a packed
+ * count word of the input queue holds
+*/
+static unsigned int keyCount(unsigned long long keys, enum InputKey kind)
+{
+	return (keys >> (kind * INPUT_KEY_BITS)) & INPUT_KEY_MAX;
+}
+
+/**
+ * Helper function that queues a key press for the next frame, shared
+ * by the keyboard thread and headless input scripts. It never waits,
+ * only one thread feeds keys to a game
+*/
+void handleKey(struct Game *game, char c, unsigned long long read_ns)
+{
+	unsigned long long keys;
+	unsigned int count;
+	enum InputKey kind;
+
+	// Change the game status to quit if q is pressed
+	if (c == QUIT)
+	{
+		endGame(game, Quit);
+		return;
+	}
+
+	// A replayed game only listens to its log
+	if (game->replaying)
+		return;
+
+	if (c == MOVE_LEFT)
+		kind = KEY_LEFT;
+	else if (c == MOVE_RIGHT)
+		kind = KEY_RIGHT;
+	else if (c == MOVE_UP)
+		kind = KEY_UP;
+	else if (c == MOVE_DOWN)
+		kind = KEY_DOWN;
+	else if (c == SHOOT)
+		kind = KEY_FIRE;
+	else
+		return;
+
+	// Only this thread adds to the counts, they can only drop under it
+	keys = __atomic_load_n(&game->input_queue.keys, __ATOMIC_RELAXED);
+	count = keyCount(keys, kind);
+	if (count >= (kind == KEY_FIRE ? MAX_PENDING_INPUTS : INPUT_KEY_MAX))
+		return;
+
+	// Stamp the key before the count that hands it over. The stamps only
+	// feed the latency histogram, one landing as the frame is taken may
+	// go with the wrong frame
+	if (kind == KEY_FIRE)
+		__atomic_store_n(&game->input_queue.fire_ns[count], read_ns, __ATOMIC_RELAXED);
+	else if (keyCount(keys, KEY_LEFT) + keyCount(keys, KEY_RIGHT)
+	         + keyCount(keys, KEY_UP) + keyCount(keys, KEY_DOWN) == 0)
+		__atomic_store_n(&game->input_queue.move_ns, read_ns, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&game->input_queue.keys, 1ULL << (kind * INPUT_KEY_BITS), __ATOMIC_RELEASE);
+}
+
+/**
+ * Helper function that applies the key presses queued since the last
+ * frame, the player moves once by the clamped sum of its moves and
+ * fires once per shot. Run by the simulation thread
+*/
+void applyInput(struct Game *game)
+{
+	struct PendingInput in;
+	unsigned long long keys;
+	int old_row = game->player.pos_r;
+	int old_col = game->player.pos_c;
+	int new_row, new_col;
+	unsigned int i;
+
+	// Take the queued keys and leave an empty queue behind
+	keys = __atomic_exchange_n(&game->input_queue.keys, 0, __ATOMIC_ACQ_REL);
+	in.dr = (int)keyCount(keys, KEY_DOWN) - (int)keyCount(keys, KEY_UP);
+	in.dc = (int)keyCount(keys, KEY_RIGHT) - (int)keyCount(keys, KEY_LEFT);
+	in.moves = keyCount(keys, KEY_LEFT) + keyCount(keys, KEY_RIGHT)
+	           + keyCount(keys, KEY_UP) + keyCount(keys, KEY_DOWN);
+	in.move_ns = __atomic_load_n(&game->input_queue.move_ns, __ATOMIC_RELAXED);
+	in.fires = keyCount(keys, KEY_FIRE);
+	for (i = 0; i < in.fires; i++)
+		in.fire_ns[i] = __atomic_load_n(&game->input_queue.fire_ns[i], __ATOMIC_RELAXED);
+
+	// A frame moves the player no further than a log record can hold,
+	// so a recorded game replays the moves it actually made
+	if (in.dr > INPUT_LOG_MOVE_MAX)
+		in.dr = INPUT_LOG_MOVE_MAX;
+	if (in.dr < -INPUT_LOG_MOVE_MAX)
+		in.dr = -INPUT_LOG_MOVE_MAX;
+	if (in.dc > INPUT_LOG_MOVE_MAX)
+		in.dc = INPUT_LOG_MOVE_MAX;
+	if (in.dc < -INPUT_LOG_MOVE_MAX)
+		in.dc = -INPUT_LOG_MOVE_MAX;
+
+	if (game->replaying)
+		takeLoggedInput(game, &in);
+	else if (game->recording)
+		logInput(game, &in);
+
+	// Move player, keeping it inside its zone of the board
+	if (in.moves > 0)
+	{
+		new_row = old_row + in.dr;
+		new_col = old_col + in.dc;
+		if (new_row < game->board.player_top)
+			new_row = game->board.player_top;
+		if (new_row > game->board.rows - P_HEIGHT)
+			new_row = game->board.rows - P_HEIGHT;
+		if (new_col < 0)
+			new_col = 0;
+		if (new_col > game->board.cols - P_LENGTH)
+			new_col = game->board.cols - P_LENGTH;
+
+		if (new_row != old_row || new_col != old_col)
+			movePlayer(game, new_row, new_col);
+		if (game->draws && !game->replaying)
+			renderStamp(in.move_ns);
+	}
+
+	// Fire a plyer bullet for every space pressed
+	for (i = 0; i < in.fires; i++)
+	{
+		addPlayerScore(game, 1);
+		createInsertBullet(game, UP, game->player.pos_r - 1, game->player.pos_c + 1);
+		if (game->draws && !game->replaying)
+			renderStamp(in.fire_ns[i]);
+	}
+}
+
+/**
+ * Helper function that returns the enemy bullet about to land on the
+ * player, the lowest one if there are several, -1 if there is none.
+ * Caller must hold bullet_list_lock
+*/
+int findThreat(struct Game *game)
+{
+	int threat = -1;
+	int b;
+
+	for (b = 0; b < game->bullets.high_water; b++)
+	{
+		if (!game->bullets.is_live[b] || game->bullets.direct[b] != DOWN)
+			continue;
+		if (game->bullets.pos_c[b] < game->player.pos_c - 1 || game->bullets.pos_c[b] > game->player.pos_c + P_LENGTH)
+			continue;
+		if (game->bullets.pos_r[b] < game->player.pos_r - AUTOPLAY_DODGE_ROWS
+		    || game->bullets.pos_r[b] >= game->player.pos_r + P_HEIGHT)
+			continue;
+		if (threat < 0 || game->bullets.pos_r[b] > game->bullets.pos_r[threat])
+			threat = b;
+	}
+	return threat;
+}
+
+/**
+ * Helper function that returns the column to fire from to meet the
+ * segment closest to the gun, leading it by how far it moves while the
+ * shot climbs to its row, -1 if no segment is on the board.
+ * Caller must hold enemy_list_lock
+*/
+int findAim(struct Game *game)
+{
+	int gun = game->player.pos_c + 1;
+	int aim = -1, best = -1;
+	int s, col, dist;
+
+	for (s = 0; s < game->num_segments; s++)
+	{
+		if (!game->segments.is_live[s] || game->segments.pos_c[s] >= game->board.cols)
+			continue;
+
+		col = (game->player.pos_r - 1 - game->segments.pos_r[s]) * BULLET_MOV_TICKS / ENEMY_MOV_TICKS;
+		col = game->segments.direct[s] == LEFT ? game->segments.pos_c[s] - col : game->segments.pos_c[s] + col;
+		if (col < 0)
+			col = 0;
+		if (col >= game->board.cols)
+			col = game->board.cols - 1;
+
+		dist = abs(col - gun);
+		if (best < 0 || dist < best)
+		{
+			best = dist;
+			aim = col;
+		}
+	}
+	return aim;
+}
+
+/**
+ * Timer callback that plays in place of a person through the same key
+ * path as the keyboard. It steps away from an enemy bullet about to land
+ * on the player, otherwise lines the gun up with the closest segment,
+ * fires once it is lined up and closes in on the caterpillar lanes
+*/
+void autoplayStep(void *arg)
+{
+	struct Game *game = arg;
+	unsigned long long now_ns = getTimeNsec();
+	int gun = game->player.pos_c + 1;
+	int threat, threat_col = -1, aim;
+
+	if (game->autoplay_end_ns > 0 && now_ns >= game->autoplay_end_ns)
+	{
+		endGame(game, Quit);
+		return;
+	}
+
+	lockMutex(&game->bullet_list_lock);
+	threat = findThreat(game);
+	if (threat >= 0)
+		threat_col = game->bullets.pos_c[threat];
+	unlockMutex(&game->bullet_list_lock);
+
+	// Dodge to the side away from the bullet, unless the board ends there
+	if (threat_col >= 0)
+	{
+		if ((threat_col <= gun && game->player.pos_c + P_LENGTH < game->board.cols) || game->player.pos_c == 0)
+			handleKey(game, MOVE_RIGHT, now_ns);
+		else
+			handleKey(game, MOVE_LEFT, now_ns);
+		return;
+	}
+
+	lockMutex(&game->enemy_list_lock);
+	aim = findAim(game);
+	unlockMutex(&game->enemy_list_lock);
+
+	if (aim >= 0 && aim < gun)
+		handleKey(game, MOVE_LEFT, now_ns);
+	else if (aim > gun)
+		handleKey(game, MOVE_RIGHT, now_ns);
+	else
+	{
+		if (aim == gun)
+			handleKey(game, SHOOT, now_ns);
+		if (game->player.pos_r > game->board.player_top)
+			handleKey(game, MOVE_UP, now_ns);
+	}
+}
+
+/**
+ * Timer callback that times every tick and writes a line of the soak log
+ * once an interval has passed. Run by the simulation thread, which owns
+ * every count it reads
+*/
+void soakCheck(void *arg)
+{
+	struct Game *game = arg;
+	unsigned long long now_ns = getTimeNsec();
+	struct SoakCounts counts;
+
+	if (!soakTick(&game->soak_log, now_ns))
+		return;
+
+	counts.ticks = game->wheel.now;
+	counts.missed = game->wheel.missed;
+	counts.bullets = game->bullets.live_count;
+	counts.bullet_slots = game->bullets.high_water;
+	lockMutex(&game->enemy_list_lock);
+	counts.segments = game->live_segments;
+	counts.segment_slots = game->num_segments;
+	unlockMutex(&game->enemy_list_lock);
+	counts.score = game->player.score;
+	counts.lives = game->player.lives;
+	soakWrite(&game->soak_log, &counts, now_ns);
+}
+
+/**
+ * Helper function that opens the input log asked for and completes
+ * the options the game is played with. A replayed game takes the
+ * seed, board, wave and end conditions of the recorded one, a game
+ * without a seed gets one from the clock. Returns false if the log
+ * cannot be opened or was recorded on a board out of range
+*/
+bool openInputLog(struct Game *game, struct GameOptions *played)
+{
+	struct InputLogHeader header;
+
+	game->recording = false;
+	game->replaying = false;
+	game->next_logged_valid = false;
+
+	if (played->replay != NULL)
+	{
+		if (!inputLogOpen(&game->input_log, played->replay, &header))
+			return false;
+		if (header.rows < MIN_GAME_ROWS || header.rows > MAX_GAME_ROWS
+		    || header.cols < MIN_GAME_COLS || header.cols > MAX_GAME_COLS)
+		{
+			inputLogClose(&game->input_log, 0);
+			return false;
+		}
+		played->seed = header.seed;
+		played->enemies = header.enemies;
+		played->spawn_ticks = header.spawn_ticks;
+		played->endless = header.endless != 0;
+		played->rows = header.rows;
+		played->cols = header.cols;
+		game->replaying = true;
+		game->next_logged_valid = inputLogRead(&game->input_log, &game->next_logged);
+		return true;
+	}
+
+	if (played->seed == 0)
+		played->seed = time(NULL);
+
+	if (played->record != NULL)
+	{
+		header.seed = played->seed;
+		header.enemies = played->enemies;
+		header.spawn_ticks = played->spawn_ticks;
+		header.endless = played->endless;
+		header.rows = played->rows;
+		header.cols = played->cols;
+		if (!inputLogCreate(&game->input_log, played->record, &header))
+			return false;
+		game->recording = true;
+	}
+	return true;
+}
+
+/**
+ * Helper function that replaces the keys of a replayed game
+ * with the input the log holds for the current tick
+*/
+void takeLoggedInput(struct Game *game, struct PendingInput *in)
+{
+	memset(in, 0, sizeof(*in));
+
+	if (!game->next_logged_valid || game->next_logged.tick != game->wheel.now)
+		return;
+
+	in->dr = game->next_logged.dr;
+	in->dc = game->next_logged.dc;
+	in->moves = (in->dr != 0 || in->dc != 0);
+	in->fires = game->next_logged.fires;
+	if (in->fires > MAX_PENDING_INPUTS)
+		in->fires = MAX_PENDING_INPUTS;
+	game->next_logged_valid = inputLogRead(&game->input_log, &game->next_logged);
+}
+
+/**
+ * Helper function that writes the input applied on this tick to the
+ * log being recorded, frames without input are left out
+*/
+void logInput(struct Game *game, const struct PendingInput *in)
+{
+	struct InputEvent event;
+
+	if ((in->moves == 0 || (in->dr == 0 && in->dc == 0)) && in->fires == 0)
+		return;
+
+	event.tick = game->wheel.now;
+	event.dr = in->moves > 0 ? in->dr : 0;
+	event.dc = in->moves > 0 ? in->dc : 0;
+	event.fires = in->fires;
+	inputLogWrite(&game->input_log, &event);
+}
+
+/**
+ * Helper function that closes the input log of a game if it has one,
+ * a recording gets the end record for end_tick
+*/
+void closeInputLog(struct Game *game, unsigned long end_tick)
+{
+	if (game->recording || game->replaying)
+		inputLogClose(&game->input_log, end_tick);
+	game->recording = false;
+	game->replaying = false;
+}
+
+/**
+ * Helper function that tells whether a replayed game reached the
+ * tick its recording ended at. Games that were won or lost end on
+ * their own on the same tick they did when recorded
+*/
+bool replayOver(struct Game *game)
+{
+	return game->replaying && !game->next_logged_valid && game->wheel.now >= game->next_logged.tick;
+}
+
+/**
+ * Helper function that moves a segment by one column, segments
+ * follow each other as they all turn at the same place
+*/
+void updateSegmentPos(struct Game *game, int s)
+{
+	// Change the animation to next one
+	game->segments.anim_count[s] = (game->segments.anim_count[s] + 1) % E_ANIMS;
+
+	if (game->segments.direct[s] == LEFT)
+		game->segments.pos_c[s]--;
+	else
+		game->segments.pos_c[s]++;
+
+	// If reached end while going left or right
+	// Start moving to the opposite direction on next line
+	// New segments start off the right edge moving left
+	if (game->segments.direct[s] == LEFT && game->segments.pos_c[s] < 0)
+	{
+		game->segments.pos_c[s] = 0;
+		game->segments.pos_r[s] += 2;
+		game->segments.direct[s] = RIGHT;
+	}
+	else if (game->segments.direct[s] == RIGHT && game->segments.pos_c[s] >= game->board.cols)
+	{
+		game->segments.pos_c[s] = game->board.cols - 1;
+		game->segments.pos_r[s] += 2;
+		game->segments.direct[s] = LEFT;
+	}
+}
+
+/**
+ * Helper function that empties the segment array
+*/
+void deleteAllEnemy(struct Game *game)
+{
+	lockMutex(&game->enemy_list_lock);
+	game->num_segments = 0;
+	game->live_segments = 0;
+	unlockMutex(&game->enemy_list_lock);
+}
+
+/**
+ * Helper function that changes player position 
+ * according to key press
+*/
+void movePlayer(struct Game *game, int new_row, int new_col)
+{
+	int old_row = game->player.pos_r;
+	int old_col = game->player.pos_c;
+
+	// Acquire bullet pool lock
+	// the pool is needed in case the player moves into a bullet
+	lockMutex(&game->bullet_list_lock);
+
+	// Clear old player position and redraw at new one
+	if (game->draws)
+	{
+		renderClearImage(old_row, old_col, P_HEIGHT, P_LENGTH);
+		renderDrawSprite(new_row, new_col, &player_sprite, game->player.anim_count);
+	}
+
+	// Move the player on the grid, then publish the new position
+	markPlayer(game, old_row, old_col, false);
+	setPlayerPos(game, new_row, new_col);
+	if (markPlayer(game, new_row, new_col, true))
+		hitPlayer(game);
+	
+	//Release the lock
+	unlockMutex(&game->bullet_list_lock);
+}
+
+/**
+ * Helper function that empties the bullet pool,
+ * every slot is chained into the free list
+*/
+void initBulletPool(struct Game *game)
+{
+	int b;
+
+	for (b = 0; b < BULLET_POOL_SIZE; b++)
+	{
+		game->bullets.is_live[b] = false;
+		game->bullets.next_free[b] = b + 1;
+	}
+	game->bullets.next_free[BULLET_POOL_SIZE - 1] = -1;
+
+	game->bullets.free_head = 0;
+	game->bullets.high_water = 0;
+	game->bullets.live_count = 0;
+}
+
+/**
+ * Helper function that returns a dead bullet slot to the free list,
+ * caller must hold bullet_list_lock
+*/
+void releaseBullet(struct Game *game, int b)
+{
+	game->bullets.is_live[b] = false;
+	game->bullets.next_free[b] = game->bullets.free_head;
+	game->bullets.free_head = b;
+	game->bullets.live_count--;
+}
+
+/**
+ * Helper function that clears a bullet from the screen and the grid
+ * if it has been drawn. Run by the simulation thread, which owns the grid
+*/
+void unplotBullet(struct Game *game, int b)
+{
+	int r = game->bullets.pos_r[b];
+	int c = game->bullets.pos_c[b];
+
+	if (r >= 0 && r < game->board.rows && c >= 0 && c < game->board.cols && cellAt(game, r, c)->bullet == b)
+	{
+		cellAt(game, r, c)->bullet = -1;
+		if (game->draws)
+			renderClearImage(r, c, 1, 1);
+	}
+}
+
+/**
+ * Helper function that clears a live bullet and reclaims its slot.
+ * Caller must hold bullet_list_lock
+*/
+void removeBullet(struct Game *game, int b)
+{
+	unplotBullet(game, b);
+	releaseBullet(game, b);
+}
+
+/**
+ * Timer callback that moves every live bullet by one row,
+ * checks the grid cell it lands on for a collision
+ * and reclaims the ones that hit something or move out of bounds
+*/
+void updateAllBullets(void *arg)
+{
+	struct Game *game = arg;
+	int b, r, c;
+	bool player_hit = false;
+	bool enemy_hit = false;
+	struct Cell *cell;
+
+	// Hold pool lock for the whole pass so new bullets wait for the next tick
+	lockMutex(&game->bullet_list_lock);
+
+	for (b = 0; b < game->bullets.high_water; b++)
+	{
+		if (!game->bullets.is_live[b])
+			continue;
+
+		// Take the bullet off its old cell
+		unplotBullet(game, b);
+
+		// Update bullet position according to the direction
+		if (game->bullets.direct[b] == UP)
+			game->bullets.pos_r[b]--;
+		else
+			game->bullets.pos_r[b]++;
+
+		r = game->bullets.pos_r[b];
+		c = game->bullets.pos_c[b];
+
+		// Check if bullet moves out of bounds if yes reclaim its slot
+		if (r >= game->board.rows || r < LANE_TOP)
+		{
+			releaseBullet(game, b);
+			continue;
+		}
+
+		// Player bullets hit caterpillars, enemy bullets hit the player
+		cell = cellAt(game, r, c);
+		if (game->bullets.direct[b] == UP && cell->segment >= 0)
+		{
+			hitSegment(game, cell->segment);
+			enemy_hit = true;
+			releaseBullet(game, b);
+			continue;
+		}
+		if (game->bullets.direct[b] == DOWN && cell->player)
+		{
+			player_hit = true;
+			releaseBullet(game, b);
+			continue;
+		}
+
+		// Update bullet position on screen and grid
+		cell->bullet = b;
+		if (!game->draws)
+			continue;
+		if (game->bullets.direct[b] == UP)
+			renderDrawSprite(r, c, &bullet_up_sprite, 0);
+		else
+			renderDrawSprite(r, c, &bullet_down_sprite, 0);
+	}
+
+	if (player_hit)
+		hitPlayer(game);
+
+	unlockMutex(&game->bullet_list_lock);
+
+	// Clear segments that were shot, the enemy list lock comes first
+	if (enemy_hit)
+	{
+		lockMutex(&game->enemy_list_lock);
+		reapDeadSegments(game);
+		unlockMutex(&game->enemy_list_lock);
+	}
+}
+
+/**
+ * Helper function that asks for a new bullet in the direction and
+ * at position provided, safe to call from any thread as it never blocks.
+ * The bullet is inserted by drainSpawns() on the next tick
+ * and dropped if the spawn queue is full
+*/
+void createInsertBullet(struct Game *game, enum Direction d, int r, int c)
+{
+	struct SpawnRequest req = {SPAWN_BULLET, r, c, d};
+
+	spawnQueuePush(&game->spawns, &req);
+}
+
+/**
+ * Helper function that takes a slot from the bullet pool for a new
+ * bullet in the direction and at position provided,
+ * it gets moved by the simulation thread from next tick.
+ * The bullet is dropped if the pool is full.
+ * Caller must hold bullet_list_lock
+*/
+void insertBullet(struct Game *game, enum Direction d, int r, int c)
+{
+	int b;
+
+	b = game->bullets.free_head;
+	if (b < 0)
+		return;
+	game->bullets.free_head = game->bullets.next_free[b];
+
+	game->bullets.pos_c[b] = c;
+	game->bullets.pos_r[b] = r;
+	game->bullets.direct[b] = d;
+	game->bullets.is_live[b] = true;	// Mark the bullet as live as it's fired
+	game->bullets.live_count++;
 
-	// Spawn the bullet thread 
-	pthread_create(&temp->bullet_thread, NULL, bulletAnimationThreadFun, (void *)temp);
+	if (b >= game->bullets.high_water)
+		game->bullets.high_water = b + 1;
 }
@@ -6,6 +6,7 @@
 ****************************************************************/
 #ifndef EXAMPLE_H
 #define EXAMPLE_H
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +19,14 @@
 #include <sys/types.h>
 #include <sys/select.h>
 
+#include "histogram.h"
+#include "soak.h"
+#include "arena.h"
+#include "timerwheel.h"
+#include "spawnqueue.h"
+#include "threadpool.h"
+#include "inputlog.h"
+
 // Key Mapping for game actions
 #define MOVE_LEFT 'a'
 #define MOVE_RIGHT 'd'
@@ -31,28 +40,64 @@
 #define P_ANIMS 8
 #define P_LENGTH 3
 
-// Dimension of enemy
+// Dimension of enemy, a caterpillar is a line of segments
 #define E_HEIGHT 2
 #define E_ANIMS 4
-#define E_LENGTH 33
+#define E_SEG_LENGTH 4
+#define E_SEGMENTS 8
+
+// Most segments in a game, 1024 caterpillars
+#define MAX_SEGMENTS 8192
+
+// Segments moved by one worker task
+#define SEGMENT_BATCH 256
+
+// Smallest board the game is laid out for, also the board of headless games
+#define MIN_GAME_ROWS 24
+#define MIN_GAME_COLS 80
 
-// Default start position of player
-#define P_START_ROW 20
-#define P_START_COL 40
+// Largest board, the console clips longer rows
+#define MAX_GAME_ROWS 1000
+#define MAX_GAME_COLS 1000
 
-// Game Board Size
-#define GAME_ROWS 24
-#define GAME_COLS 80
+// Row caterpillars come in on, everything above it is the score and title
+#define LANE_TOP 2
+
+// Columns of the score and of the lives, counted from the right edge
+#define SCORE_COL 16
+#define LIVES_COL_FROM_RIGHT 22
 
 // Ticks for thread loops
-#define SCORE_UPDATE_TICKS 25
-#define SCREEN_REFRESH_TICKS 2
+#define INPUT_TICKS 2
 #define PLAYER_ANIM_TICKS 40
 #define ENEMY_GEN_TICKS 500
-#define UPKEEP_INT_TICKS 300
 #define BULLET_MOV_TICKS 15
 #define ENEMY_MOV_TICKS 30
 
+// Ticks in a second of game time, and the default cap on frames presented in one
+#define TICKS_PER_SEC 100
+#define DEFAULT_MAX_FPS 50
+
+// Maximum number of bullets alive at once
+#define BULLET_POOL_SIZE 1024
+
+// Most key presses waiting to be shown on screen at once
+#define MAX_PENDING_INPUTS 64
+
+// Most bytes taken from the terminal by one read
+#define INPUT_READ_SIZE 64
+
+// Number of caterpillars to kill to win and points for each segment shot
+#define DEFAULT_WAVE_SIZE 8
+#define SEGMENT_KILL_SCORE 10
+
+// Default ticks between two keys of a headless input script
+#define SCRIPT_KEY_TICKS 5
+
+// Rows above the player an enemy bullet is dodged from by the autoplay bot
+#define AUTOPLAY_DODGE_ROWS 3
+
+
 // enumertion to store the movement direction
 enum Direction
 {
@@ -62,6 +107,13 @@ enum Direction
     DOWN
 };
 
+// Enumeration to store what a spawn request asks for
+enum SpawnKind
+{
+    SPAWN_BULLET,
+    SPAWN_ENEMY
+};
+
 // Enumeration to store the game status
 enum GAME_STATUS
 {
@@ -72,66 +124,348 @@ enum GAME_STATUS
     Error
 };
 
-// Struct to store player info
+// Struct to store how the game was asked to run from the command line
+struct GameOptions
+{
+    bool headless;              // Run without a terminal and without sleeping
+    unsigned long max_ticks;    // Headless runs stop after this many ticks, 0 for no limit
+    const char *script;         // Keys fed to a headless game in a loop, NULL for no input
+    unsigned int script_ticks;  // Ticks between two scripted keys
+    unsigned int enemies;       // Caterpillars in the wave
+    unsigned int spawn_ticks;   // Ticks between two caterpillars, 0 for random intervals
+    bool endless;               // Ignore win and lose conditions, for benchmarks
+    unsigned int seed;          // Seed of the pseudo randomizer, 0 to seed from the clock
+    const char *record;         // Input log written during the game, NULL for none
+    const char *replay;         // Input log played back in place of the keyboard, NULL for none
+    int rows;                   // Board size, 0 to fit the terminal, headless
+    int cols;                   // games get the smallest board
+    bool ansi;                  // Draw with raw ANSI escapes instead of curses
+    unsigned int max_fps;       // Most frames presented per second, 0 for no cap
+    bool autoplay;              // Let the autoplay bot play in place of the keyboard
+    unsigned long autoplay_secs;    // Seconds the bot plays for, 0 until the game ends
+    const char *soak_log;       // Soak log written during the game, NULL for none
+    unsigned int soak_secs;     // Seconds between two lines of the soak log
+};
+
+// Struct to store what happened during a game, filled in by exampleRun()
+struct GameReport
+{
+    enum GAME_STATUS status;    // How the game ended
+    unsigned int seed;          // Seed the game was played with
+    int rows;                   // Board size the game was played on
+    int cols;
+    unsigned long ticks;        // Ticks simulated
+    unsigned long missed;       // Tick deadlines missed
+    unsigned long spawns_dropped;   // Spawn requests lost to a full spawn queue
+    unsigned int score;
+    unsigned int lives;
+    unsigned long long run_ns;      // Wall time from start to end of the game
+    unsigned long long shutdown_ns; // Wall time from the game ending to every game thread gone
+    unsigned long long render_ns;   // Part of it spent presenting frames
+    unsigned long frames;           // Frames presented
+    unsigned long render_stalls;    // Times a thread waited for room on its render ring
+    unsigned long cells;            // Cells sent to the terminal
+    unsigned long scanned;          // Cells compared to find them
+    unsigned long long bytes;       // Bytes written to the terminal
+    unsigned long long writes;      // Write calls made for them
+    struct Histogram frame_time;    // Wall time between two presented frames
+    struct Histogram input_latency; // Key press to frame on terminal
+    struct ArenaStats memory;       // What the game allocated
+};
+
+// Kinds of key counted by the input queue, each gets INPUT_KEY_BITS
+// bits of the packed count word
+enum InputKey
+{
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_FIRE,
+    KEY_KINDS
+};
+
+#define INPUT_KEY_BITS 12
+#define INPUT_KEY_MAX ((1u << INPUT_KEY_BITS) - 1)
+
+// Struct to store the keys read and not yet taken by the simulation. The
+// keyboard thread counts each key with one atomic add to keys and the
+// simulation takes every count with one exchange, so neither waits
+struct InputQueue
+{
+    unsigned long long keys;        // Count of each InputKey, packed
+    unsigned long long move_ns;     // Time the first move was read
+    unsigned long long fire_ns[MAX_PENDING_INPUTS];  // Time each shot was read
+};
+
+// Struct to store the key presses taken for a frame,
+// moves are summed into one delta and shots are kept one by one
+struct PendingInput
+{
+    int dr;                     // Net rows and columns the
+    int dc;                     // player was asked to move
+    unsigned int moves;         // Movement keys folded into the delta
+    unsigned long long move_ns; // Time the first of them was read
+    unsigned int fires;         // Shots asked for
+    unsigned long long fire_ns[MAX_PENDING_INPUTS];  // Time each shot was read
+};
+
+// Struct to store player info. Only the simulation thread changes it and
+// every change is bracketed by seq, other threads read it with readPlayer()
 struct Player
 {
+    unsigned int seq;               // Odd while a change is under way
     int pos_r;                      // Coordinates of 
     int pos_c;                      // upper left corner
     
     unsigned int lives;             // Number of lives remaining
     unsigned int score;             
     unsigned int anim_count;        // Animation counter
-    pthread_mutex_t player_lock;    // Mutex lock of player
-    pthread_t anim_thread;          // Thread that handles player animation
 };
 
-// Struct to store bullet info
-struct Bullet
+// Struct to store a consistent copy of the player
+struct PlayerView
+{
+    int pos_r;
+    int pos_c;
+    unsigned int lives;
+    unsigned int score;
+    unsigned int anim_count;
+};
+
+// Struct to store all bullets, one array per field
+// indexed by bullet slot, dead slots are chained into a free list
+struct BulletPool
+{
+    int pos_r[BULLET_POOL_SIZE];                // Coordinates of 
+    int pos_c[BULLET_POOL_SIZE];                // bullet
+    enum Direction direct[BULLET_POOL_SIZE];    // Direction in which the bullet is heading
+    bool is_live[BULLET_POOL_SIZE];             // Whether the slot holds a bullet in flight
+
+    int next_free[BULLET_POOL_SIZE];            // Next dead slot in the free list
+    int free_head;                              // First dead slot, -1 when pool is full
+    int high_water;                             // One past the highest slot ever used
+    int live_count;                             // Number of bullets in flight
+};
+
+// Struct to store all segments, one array per field indexed by segment.
+// The segments of a caterpillar sit next to each other, a run of live
+// segments moves as one piece led by its first segment, so shooting a
+// segment splits a run. Each pass only streams the fields it needs
+struct SegmentPool
 {
-    int pos_r;                  // Coordinates of 
-    int pos_c;                  // bullet
+    int pos_r[MAX_SEGMENTS];                    // Coordinates of the leading column
+    int pos_c[MAX_SEGMENTS];                    // of segment
+    enum Direction direct[MAX_SEGMENTS];        // Direction in which segment is moving
 
-    char *anim[1];              // 2D representation of bullet
-    bool is_live;               // Whether the bullet is live or dead due to being out of bounds
-    enum Direction direct;      // Direction in which the bullet is heading
-    pthread_t bullet_thread;    // Thread that simulates bullet movement
-    struct Bullet *next;        // Pointer to next bullet to use as a linked list
+    unsigned int anim_count[MAX_SEGMENTS];      // Animation counter of segment
+    int fire_timer[MAX_SEGMENTS];               // Moves left before the run fires, while leading it
+    unsigned int seed[MAX_SEGMENTS];            // Seed for random fire intervals of this segment
+
+    bool is_live[MAX_SEGMENTS];                 // Cleared when shot, segment is cleared at the end of the pass
+    bool drawn[MAX_SEGMENTS];                   // Whether segment is on screen
+    int drawn_r[MAX_SEGMENTS];                  // Position and direction the
+    int drawn_c[MAX_SEGMENTS];                  // segment was last drawn with,
+    enum Direction drawn_direct[MAX_SEGMENTS];  // used to clear it
 };
 
-// Struct to store caterpillar/enemy info 
-struct Enemy
+// Struct to store the board size picked at startup and the zones laid
+// out on it, the zones keep the proportions of the 24x80 board
+struct Board
 {
-    int pos_r;                  // Coordinates of upper left corner 
-    int pos_c;                  // of caterpillar
+    int rows;                   // Board size
+    int cols;
+    int lane_bottom;            // Lowest lane, a caterpillar going below it wins
+    int fence_row;              // Row of the fence between caterpillars and player
+    int player_top;             // Highest row the player can move up to
+    int start_row;              // Start position of player
+    int start_col;
+};
 
-    unsigned int anim_count;    // Animation counter of caterpillar
-    enum Direction direct;      // Direction in which caterpillar is moving
+// Struct to store what occupies a cell of the game board
+struct Cell
+{
+    int segment;                // Caterpillar segment covering the cell or -1
+    int bullet;                 // Bullet slot in the cell or -1
+    bool player;                // Whether the player covers the cell
+};
 
-    pthread_t enemy_thread;     // Thread to animate  caterpillar movement
-    struct Enemy *next;         // Pointer to next caterpillar to use as a linked list
+// Struct to store the segments one worker task moves
+struct EnemyBatch
+{
+    struct Game *game;
+    int first;                  // First segment of the batch
 };
 
-// Driver function
-void exampleRun();
+// Struct to store everything one game is made of. Games share nothing they
+// write but the console, which only the game of exampleRun() draws on, so a
+// process can run as many games made by gameCreate() side by side as it likes
+struct Game
+{
+    const struct GameOptions *options;  // How the game was asked to run
+    struct GameOptions played_options;  // Options with what a replayed log overrides
+
+    struct Player player;           // Holds player info
+    struct BulletPool bullets;      // Pool that holds all bullets
+    struct SegmentPool segments;    // Caterpillars, E_SEGMENTS consecutive segments each
+    int num_segments;               // Segments ever used, live or dead
+    int live_segments;              // Segments not shot yet
+    unsigned int enemies_requested; // Number of caterpillars asked for so far
+    unsigned int enemies_spawned;   // Number of caterpillars generated so far
+    enum GAME_STATUS game_status;   // Variable to store game status, only use gameStatus() and endGame()
+    unsigned long long ended_ns;    // Time the game status left Running
+    struct random_data rng;         // Pseudo randomizer of the game, seeded from options->seed
+    char rng_state[128];
+
+    struct Board board;             // Board size and zones, picked at startup
+    struct Cell *grid;              // What occupies each board cell, row after row, only the simulation thread touches it
+    char **board_image;             // Game board look, one string per row
+    char *board_text;               // Rows that are not blank
+    struct Arena session;           // Every allocation of the game, emptied when it ends
+
+    pthread_t keyboard_thread;      // Thread to handle keypress
+    pthread_t sim_thread;           // Thread that runs the timer wheel
+    int shutdown_fd;                // Event every sleeping thread also waits on, readable once the game ended
+    struct ThreadPool workers;      // Worker threads that update enemies in parallel
+    bool use_workers;               // Whether workers were started, enemies move inline otherwise
+    struct EnemyBatch enemy_batches[MAX_SEGMENTS / SEGMENT_BATCH];
+
+    // Bullets and enemies waiting to be spawned, pushed by any
+    // thread without blocking and drained by the simulation every tick
+    struct SpawnQueue spawns;
+
+    // Timer wheel and the timers of every periodic game activity
+    struct TimerWheel wheel;
+    struct Timer refresh_timer;     // Applies input and presents changed frames
+    struct Timer player_anim_timer; // Changes player animation
+    struct Timer enemy_gen_timer;   // Generates enemy/caterpillar
+    struct Timer bullet_timer;      // Advances all bullets
+    struct Timer enemy_timer;       // Advances all enemies
+    struct Timer spawn_timer;       // Drains the spawn queue
+    struct Timer autoplay_timer;    // Presses keys in place of a person
+    struct Timer soak_timer;        // Times ticks and writes the soak log
+
+    // Keys read by the keyboard thread, applied once per frame by refreshScreen()
+    struct InputQueue input_queue;
+
+    unsigned long last_frame_slot;  // Frame rate cap slot of the last frame presented
+    unsigned int hud_score;         // Score and lives on screen, hud_drawn
+    unsigned int hud_lives;         // is false until they were drawn once
+    bool hud_drawn;
+    bool draws;                     // Whether the game owns the renderer, only the game of exampleRun() does
+
+    // Input log being recorded or replayed, only the simulation thread touches it
+    struct InputLog input_log;
+    bool recording;                 // Whether applied input is written to the log
+    bool replaying;                 // Whether applied input is read from the log
+    struct InputEvent next_logged;  // Next input of the log, read one ahead
+    bool next_logged_valid;         // False once the log has no more input
+
+    // Soak test state, only the simulation thread touches it
+    struct SoakLog soak_log;
+    bool soaking;                   // Whether the soak log is written
+    unsigned long long autoplay_end_ns; // Time the bot stops playing, 0 for never
+
+    pthread_mutex_t bullet_list_lock;   // Lock to be acquired for modifying bullet pool
+    pthread_mutex_t enemy_list_lock;    // Lock to be acquired for modifying the segment array
+};
+
+// Actions a library user can take on a tick, each is the key that does it
+enum GameAction
+{
+    ACTION_NONE = 0,
+    ACTION_LEFT = MOVE_LEFT,
+    ACTION_RIGHT = MOVE_RIGHT,
+    ACTION_UP = MOVE_UP,
+    ACTION_DOWN = MOVE_DOWN,
+    ACTION_FIRE = SHOOT,
+    ACTION_QUIT = QUIT
+};
+
+// Driver function, report may be NULL
+void exampleRun(const struct GameOptions *opts, struct GameReport *report);
+
+// Library interface for running games without a terminal or threads of
+// their own. A game is created headless, advanced one tick per gameStep()
+// without sleeping and never reaches the renderer. Games may be stepped from different
+// threads at once, each game from one thread at a time
+struct Game *gameCreate(const struct GameOptions *opts);
+enum GAME_STATUS gameStep(struct Game *game, enum GameAction action);
+void gameGetReport(struct Game *game, struct GameReport *report);
+void gameDestroy(struct Game *game);
 
 // Thread functions that simulate 
-void *keyboardThreadFun();
-void *enemyGenThreadFun();
-void *bulletUpkeepThreadFun();
-void *playerAnimationThreadFun();
-void *updateScoreScreenThreadFun();
-void *bulletAnimationThreadFun(void *arg);
-void *enemyAnimationThreadFun(void *arg);
+void *keyboardThreadFun(void *arg);
+void *simulationThreadFun(void *arg);
+void *headlessThreadFun(void *arg);
+
+// Timer callbacks run by the simulation thread, arg is the game
+void spawnEnemy(void *arg);
+void drainSpawns(void *arg);
+void refreshScreen(void *arg);
+void autoplayStep(void *arg);
+void soakCheck(void *arg);
+void animatePlayer(void *arg);
+void updateAllBullets(void *arg);
+void updateAllEnemies(void *arg);
 
 // Helper functions to breakup large pieces of code 
-void initLocks();
-void initPlayer();
-void destroyLocks();
-void printGameExit();
-void deleteAllEnemy();
-void deleteAllBullets();
-void movePlayer(int old_row, int old_col);
-void updateEnemyPos(struct Enemy * e, int * r, int * c);
-void createInsertBullet(enum Direction d, int r, int c);
+void initLocks(struct Game *game);
+void initSprites();
+void initTimers(struct Game *game);
+bool prepareGame(struct Game *game, const struct GameOptions *opts, size_t reserve);
+void startGame(struct Game *game);
+int gameRand(struct Game *game);
+void handleKey(struct Game *game, char c, unsigned long long read_ns);
+int findThreat(struct Game *game);
+int findAim(struct Game *game);
+void applyInput(struct Game *game);
+void updateHud(struct Game *game);
+enum GAME_STATUS gameStatus(struct Game *game);
+bool endGame(struct Game *game, enum GAME_STATUS status);
+bool openInputLog(struct Game *game, struct GameOptions *played);
+void pickBoardSize(struct GameOptions *played);
+void layoutBoard(struct Game *game, int rows, int cols);
+bool buildBoardImage(struct Game *game);
+size_t boardReserve(int rows, int cols);
+void freeSession(struct Game *game);
+struct Cell *cellAt(struct Game *game, int r, int c);
+void takeLoggedInput(struct Game *game, struct PendingInput *in);
+void logInput(struct Game *game, const struct PendingInput *in);
+bool replayOver(struct Game *game);
+void closeInputLog(struct Game *game, unsigned long end_tick);
+int compareSpawns(const void *a, const void *b);
+void initPlayer(struct Game *game);
+void readPlayer(struct Game *game, struct PlayerView *out);
+void setPlayerPos(struct Game *game, int row, int col);
+void setPlayerAnim(struct Game *game, unsigned int anim_count);
+void addPlayerScore(struct Game *game, unsigned int points);
+void takePlayerLife(struct Game *game);
+void destroyLocks(struct Game *game);
+void printGameExit(struct Game *game);
+void deleteAllEnemy(struct Game *game);
+void initBulletPool(struct Game *game);
+void movePlayer(struct Game *game, int new_row, int new_col);
+void releaseBullet(struct Game *game, int b);
+void updateSegmentPos(struct Game *game, int s);
+void updateEnemyTask(void *arg);
+bool isRunLeader(struct Game *game, int s);
+int segmentCol(int c, enum Direction d);
+int findDeadBlock(struct Game *game);
+void clearSegment(struct Game *game, int s);
+void drawSegment(struct Game *game, int s);
+void initGrid(struct Game *game);
+void markSegment(struct Game *game, int s, int row, int col);
+void unmarkSegment(struct Game *game, int s, int row, int col);
+bool markPlayer(struct Game *game, int row, int col, bool set);
+void hitSegment(struct Game *game, int s);
+void hitPlayer(struct Game *game);
+void reapDeadSegments(struct Game *game);
+void dumpLatency(int sig);
+void unplotBullet(struct Game *game, int b);
+void removeBullet(struct Game *game, int b);
+void createInsertBullet(struct Game *game, enum Direction d, int r, int c);
+void insertBullet(struct Game *game, enum Direction d, int r, int c);
+bool insertEnemy(struct Game *game);
 
 #endif
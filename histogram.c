@@ -0,0 +1,93 @@
+#include "histogram.h"
+#include <string.h>
+
+#define NSEC_PER_USEC 1000.0
+
+/**
+ * Helper function that maps a value to its bucket, values below
+ * 2 * HIST_SUB_COUNT get a bucket each, larger values share a bucket
+ * with the values that agree on their top HIST_SUB_BITS + 1 bits
+ */
+static int histIndex(unsigned long long value)
+{
+	int msb, shift;
+
+	if (value < 2 * HIST_SUB_COUNT)
+		return value;
+
+	msb = 63 - __builtin_clzll(value);
+	shift = msb - HIST_SUB_BITS;
+	return shift * HIST_SUB_COUNT + (int)(value >> shift);
+}
+
+/**
+ * Helper function that returns the largest value mapping to a bucket
+ */
+static unsigned long long histBucketMax(int index)
+{
+	int shift;
+
+	if (index < 2 * HIST_SUB_COUNT)
+		return index;
+
+	shift = index / HIST_SUB_COUNT - 1;
+	return ((unsigned long long)(index - shift * HIST_SUB_COUNT + 1) << shift) - 1;
+}
+
+/**
+ * Function that empties the histogram
+ */
+void histReset(struct Histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+/**
+ * Function that counts a value in its bucket
+ */
+void histRecord(struct Histogram *h, unsigned long long value)
+{
+	h->counts[histIndex(value)]++;
+	h->total++;
+	if (value > h->max)
+		h->max = value;
+}
+
+/**
+ * Function that walks the buckets until the requested share
+ * of values is covered, returns 0 for an empty histogram
+ */
+unsigned long long histPercentile(const struct Histogram *h, double percentile)
+{
+	unsigned long long target, seen = 0;
+	int i;
+
+	if (h->total == 0)
+		return 0;
+
+	target = (unsigned long long)(h->total * percentile / 100.0 + 0.5);
+	if (target < 1)
+		target = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += h->counts[i];
+		if (seen >= target)
+			return histBucketMax(i) < h->max ? histBucketMax(i) : h->max;
+	}
+	return h->max;
+}
+
+/**
+ * Function that prints a one line summary of nanosecond values in microseconds
+ */
+void histPrint(const struct Histogram *h, FILE *out, const char *name)
+{
+	fprintf(out, "%s: count %llu p50 %.1fus p90 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n",
+	        name, h->total,
+	        histPercentile(h, 50.0) / NSEC_PER_USEC,
+	        histPercentile(h, 90.0) / NSEC_PER_USEC,
+	        histPercentile(h, 99.0) / NSEC_PER_USEC,
+	        histPercentile(h, 99.9) / NSEC_PER_USEC,
+	        h->max / NSEC_PER_USEC);
+}
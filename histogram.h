@@ -0,0 +1,38 @@
+/***************************************************************
+ *  Header file for a log-linear histogram in the style of
+ *  HdrHistogram. Every power of two range is split into 32
+ *  equal buckets so recorded values keep ~3% precision from
+ *  nanoseconds up to hours in a fixed amount of memory
+ *  Refer to histogram.c for detailed use of code
+****************************************************************/
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+
+// Number of bits of precision kept for each value
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// Struct to store histogram info
+struct Histogram
+{
+    unsigned long long counts[HIST_BUCKETS];    // Values recorded per bucket
+    unsigned long long total;                   // Number of values recorded
+    unsigned long long max;                     // Largest value recorded
+};
+
+// Empties the histogram
+void histReset(struct Histogram *h);
+
+// Records one value
+void histRecord(struct Histogram *h, unsigned long long value);
+
+// Returns the value at or below which `percentile' percent of values fall
+unsigned long long histPercentile(const struct Histogram *h, double percentile);
+
+// Prints count, p50, p90, p99, p99.9 and max in microseconds on one line
+void histPrint(const struct Histogram *h, FILE *out, const char *name);
+
+#endif
@@ -0,0 +1,201 @@
+#include "inputlog.h"
+#include <string.h>
+
+/**
+ * Helper function that writes a 32 bit value little endian
+ */
+static void putU32(FILE *f, uint32_t v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		fputc((v >> (8 * i)) & 0xff, f);
+}
+
+/**
+ * Helper function that reads a 32 bit little endian value,
+ * returns false at the end of the file
+ */
+static bool getU32(FILE *f, uint32_t *v)
+{
+	int i, c;
+
+	*v = 0;
+	for (i = 0; i < 4; i++)
+	{
+		c = fgetc(f);
+		if (c == EOF)
+			return false;
+		*v |= (uint32_t)c << (8 * i);
+	}
+	return true;
+}
+
+/**
+ * Helper function that writes a value 7 bits at a time,
+ * low bits first, the high bit is set on all but the last byte
+ */
+static void putVarint(FILE *f, unsigned long v)
+{
+	while (v >= 0x80)
+	{
+		fputc((v & 0x7f) | 0x80, f);
+		v >>= 7;
+	}
+	fputc(v, f);
+}
+
+/**
+ * Helper function that reads a value written by putVarint(),
+ * returns false at the end of the file
+ */
+static bool getVarint(FILE *f, unsigned long *v)
+{
+	int shift = 0;
+	int c;
+
+	*v = 0;
+	do
+	{
+		c = fgetc(f);
+		if (c == EOF || shift >= 64)
+			return false;
+		*v |= (unsigned long)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return true;
+}
+
+/**
+ * Helper function that clamps a move to what a signed byte holds
+ */
+static int clampMove(int v)
+{
+	if (v > INPUT_LOG_MOVE_MAX)
+		return INPUT_LOG_MOVE_MAX;
+	if (v < -INPUT_LOG_MOVE_MAX)
+		return -INPUT_LOG_MOVE_MAX;
+	return v;
+}
+
+/**
+ * Function that creates a log for recording
+ */
+bool inputLogCreate(struct InputLog *log, const char *path, const struct InputLogHeader *header)
+{
+	log->file = fopen(path, "wb");
+	if (log->file == NULL)
+		return false;
+	log->last_tick = 0;
+	log->writing = true;
+	log->ended = false;
+
+	fwrite(INPUT_LOG_MAGIC, 1, 4, log->file);
+	putU32(log->file, INPUT_LOG_VERSION);
+	putU32(log->file, header->seed);
+	putU32(log->file, header->enemies);
+	putU32(log->file, header->spawn_ticks);
+	putU32(log->file, header->endless);
+	putU32(log->file, header->rows);
+	putU32(log->file, header->cols);
+	return true;
+}
+
+/**
+ * Function that opens a log for replay and checks its header
+ */
+bool inputLogOpen(struct InputLog *log, const char *path, struct InputLogHeader *header)
+{
+	bool ok;
+
+	log->file = fopen(path, "rb");
+	if (log->file == NULL)
+		return false;
+	log->last_tick = 0;
+	log->writing = false;
+	log->ended = false;
+
+	ok = fread(header->magic, 1, 4, log->file) == 4
+	     && memcmp(header->magic, INPUT_LOG_MAGIC, 4) == 0
+	     && getU32(log->file, &header->version)
+	     && header->version == INPUT_LOG_VERSION
+	     && getU32(log->file, &header->seed)
+	     && getU32(log->file, &header->enemies)
+	     && getU32(log->file, &header->spawn_ticks)
+	     && getU32(log->file, &header->endless)
+	     && getU32(log->file, &header->rows)
+	     && getU32(log->file, &header->cols);
+	if (!ok)
+	{
+		fclose(log->file);
+		log->file = NULL;
+	}
+	return ok;
+}
+
+/**
+ * Function that appends one record
+ */
+void inputLogWrite(struct InputLog *log, const struct InputEvent *event)
+{
+	putVarint(log->file, event->tick - log->last_tick);
+	fputc(event->fires < INPUT_LOG_END ? event->fires : INPUT_LOG_END - 1, log->file);
+	fputc((signed char)clampMove(event->dr), log->file);
+	fputc((signed char)clampMove(event->dc), log->file);
+	log->last_tick = event->tick;
+}
+
+/**
+ * Function that reads one record, a log cut short
+ * is treated as if it ended at its last record
+ */
+bool inputLogRead(struct InputLog *log, struct InputEvent *event)
+{
+	unsigned long delta;
+	int fires, dr, dc;
+
+	if (log->ended)
+		return false;
+
+	if (!getVarint(log->file, &delta))
+	{
+		log->ended = true;
+		event->tick = log->last_tick;
+		return false;
+	}
+	fires = fgetc(log->file);
+	dr = fgetc(log->file);
+	dc = fgetc(log->file);
+
+	event->tick = log->last_tick + delta;
+	log->last_tick = event->tick;
+	if (fires == INPUT_LOG_END || dc == EOF)
+	{
+		log->ended = true;
+		return false;
+	}
+
+	event->fires = fires;
+	event->dr = (signed char)dr;
+	event->dc = (signed char)dc;
+	return true;
+}
+
+/**
+ * Function that ends a log, a log being recorded gets its end record
+ */
+void inputLogClose(struct InputLog *log, unsigned long end_tick)
+{
+	if (log->file == NULL)
+		return;
+
+	if (log->writing && !log->ended)
+	{
+		putVarint(log->file, end_tick - log->last_tick);
+		fputc(INPUT_LOG_END, log->file);
+		fputc(0, log->file);
+		fputc(0, log->file);
+	}
+	fclose(log->file);
+	log->file = NULL;
+}
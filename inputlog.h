@@ -0,0 +1,75 @@
+/***************************************************************
+ *  Header file for input logs, compact binary files holding
+ *  the seed, board size and settings of a game and the input
+ *  applied to it on every tick. Replaying a log plays the same
+ *  game again tick by tick. A log is a header followed by one
+ *  record per frame with input, each record is the ticks since
+ *  the last record as a base 128 varint, a shot count byte and
+ *  the row and column moves as signed bytes. A shot count of
+ *  0xff marks the tick the game ended at
+ *  Refer to inputlog.c for detailed use of code
+****************************************************************/
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define INPUT_LOG_MAGIC "CPIL"
+#define INPUT_LOG_VERSION 2
+
+// Shot count of the record that ends a log
+#define INPUT_LOG_END 0xff
+
+// Most rows or columns a record moves the player each way
+#define INPUT_LOG_MOVE_MAX 127
+
+// Struct to store what a game needs to be played again, stored little endian
+struct InputLogHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t seed;                  // Seed of the pseudo randomizer
+    uint32_t enemies;               // Caterpillars in the wave
+    uint32_t spawn_ticks;           // Ticks between two caterpillars, 0 for random
+    uint32_t endless;               // Whether win and lose conditions were ignored
+    uint32_t rows;                  // Board size
+    uint32_t cols;
+};
+
+// Struct to store the input applied on one tick
+struct InputEvent
+{
+    unsigned long tick;             // Tick the input was applied on
+    int dr;                         // Rows and columns the player was asked to move
+    int dc;
+    unsigned int fires;             // Shots fired
+};
+
+// Struct to store an open log
+struct InputLog
+{
+    FILE *file;
+    unsigned long last_tick;        // Tick of the last record read or written
+    bool writing;                   // Whether the log is being recorded
+    bool ended;                     // Whether the end record was read
+};
+
+// Creates the log at path and writes its header, returns false on failure
+bool inputLogCreate(struct InputLog *log, const char *path, const struct InputLogHeader *header);
+
+// Opens the log at path and reads its header, returns false if it is not a valid log
+bool inputLogOpen(struct InputLog *log, const char *path, struct InputLogHeader *header);
+
+// Appends the input of a tick, ticks must not go backwards
+void inputLogWrite(struct InputLog *log, const struct InputEvent *event);
+
+// Reads the next record, returns false at the end of the log. After
+// the end record event->tick holds the tick the game ended at
+bool inputLogRead(struct InputLog *log, struct InputEvent *event);
+
+// Writes the end record when recording and closes the log
+void inputLogClose(struct InputLog *log, unsigned long end_tick);
+
+#endif
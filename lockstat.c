@@ -0,0 +1,179 @@
+#include "lockstat.h"
+#include "console.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Deepest nesting of instrumented locks held by one thread
+#define MAX_HELD_LOCKS 8
+
+#define NSEC_PER_USEC 1000.0
+#define NSEC_PER_MSEC 1000000.0
+
+// Struct to store a lock currently held by the calling thread
+struct HeldLock
+{
+    pthread_mutex_t *mutex;
+    struct LockSite *site;
+    unsigned long long acquired_ns;
+};
+
+// Every site that took a lock at least once
+static struct LockSite *sites = NULL;
+
+// Locks held by this thread, innermost last
+static __thread struct HeldLock held[MAX_HELD_LOCKS];
+static __thread int num_held = 0;
+
+/**
+ * Helper function that links a site into the site list the first time it is used
+ */
+static void registerSite(struct LockSite *site, pthread_mutex_t *mutex)
+{
+	struct LockSite *head;
+
+	if (__atomic_exchange_n(&site->registered, true, __ATOMIC_ACQ_REL))
+		return;
+
+	site->mutex = mutex;
+	head = __atomic_load_n(&sites, __ATOMIC_ACQUIRE);
+	do
+		site->next = head;
+	while (!__atomic_compare_exchange_n(&sites, &head, site, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Helper function that raises *max to v if v is larger
+ */
+static void atomicMax(unsigned long long *max, unsigned long long v)
+{
+	unsigned long long cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (v > cur && !__atomic_compare_exchange_n(max, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * Function that locks the mutex. A site is shared by the same lock of
+ * every game, so its counters are updated atomically rather than under
+ * the mutex, which only belongs to one game
+ */
+void lockStatAcquire(pthread_mutex_t *mutex, struct LockSite *site)
+{
+	unsigned long long start, acquired, wait;
+
+	registerSite(site, mutex);
+
+	start = getTimeNsec();
+	pthread_mutex_lock(mutex);
+	acquired = getTimeNsec();
+
+	wait = acquired - start;
+	__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&site->wait_ns, wait, __ATOMIC_RELAXED);
+	atomicMax(&site->wait_max_ns, wait);
+
+	if (num_held < MAX_HELD_LOCKS)
+	{
+		held[num_held].mutex = mutex;
+		held[num_held].site = site;
+		held[num_held].acquired_ns = acquired;
+		num_held++;
+	}
+}
+
+/**
+ * Function that finds the site that took the mutex on this thread,
+ * charges it the hold time and unlocks the mutex
+ */
+void lockStatRelease(pthread_mutex_t *mutex)
+{
+	unsigned long long hold;
+	struct LockSite *site;
+	int i;
+
+	for (i = num_held - 1; i >= 0; i--)
+	{
+		if (held[i].mutex != mutex)
+			continue;
+
+		site = held[i].site;
+		hold = getTimeNsec() - held[i].acquired_ns;
+		__atomic_fetch_add(&site->hold_ns, hold, __ATOMIC_RELAXED);
+		atomicMax(&site->hold_max_ns, hold);
+
+		// Locks are not always released in reverse order
+		held[i] = held[--num_held];
+		break;
+	}
+
+	pthread_mutex_unlock(mutex);
+}
+
+/**
+ * Helper function that orders sites by lock, then by total wait, longest first
+ */
+static int compareSites(const void *a, const void *b)
+{
+	const struct LockSite *x = *(const struct LockSite **)a;
+	const struct LockSite *y = *(const struct LockSite **)b;
+
+	if (x->mutex != y->mutex)
+		return x->mutex < y->mutex ? -1 : 1;
+	if (x->wait_ns != y->wait_ns)
+		return x->wait_ns > y->wait_ns ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Function that prints the summary table, meant
+ * to be called once all game threads have been joined
+ */
+void lockStatPrint(FILE *out)
+{
+	struct LockSite **table;
+	struct LockSite *site;
+	const char *name;
+	int name_width = strlen("lock"), func_width = strlen("site");
+	int n = 0, i;
+
+	for (site = sites; site != NULL; site = site->next)
+		n++;
+	if (n == 0)
+		return;
+
+	table = malloc(n * sizeof(*table));
+	if (table == NULL)
+		return;
+	for (i = 0, site = sites; site != NULL; site = site->next)
+		table[i++] = site;
+	qsort(table, n, sizeof(*table), compareSites);
+
+	// Columns are as wide as the longest lock and function names
+	for (i = 0; i < n; i++)
+	{
+		name = table[i]->lock_name[0] == '&' ? table[i]->lock_name + 1 : table[i]->lock_name;
+		if ((int)strlen(name) > name_width)
+			name_width = strlen(name);
+		if ((int)strlen(table[i]->func) > func_width)
+			func_width = strlen(table[i]->func);
+	}
+
+	fprintf(out, "%-*s %-*s %10s %12s %10s %10s %12s %10s %10s\n",
+	        name_width, "lock", func_width, "site", "count", "wait ms", "wait avg", "wait max",
+	        "hold ms", "hold avg", "hold max");
+
+	for (i = 0; i < n; i++)
+	{
+		site = table[i];
+		name = site->lock_name[0] == '&' ? site->lock_name + 1 : site->lock_name;
+		fprintf(out, "%-*s %-*s %10lu %12.3f %8.1fus %8.1fus %12.3f %8.1fus %8.1fus\n",
+		        name_width, name, func_width, site->func, site->count,
+		        site->wait_ns / NSEC_PER_MSEC,
+		        site->count ? site->wait_ns / NSEC_PER_USEC / site->count : 0.0,
+		        site->wait_max_ns / NSEC_PER_USEC,
+		        site->hold_ns / NSEC_PER_MSEC,
+		        site->count ? site->hold_ns / NSEC_PER_USEC / site->count : 0.0,
+		        site->hold_max_ns / NSEC_PER_USEC);
+	}
+	free(table);
+}
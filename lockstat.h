@@ -0,0 +1,53 @@
+/***************************************************************
+ *  Header file for opt-in lock contention instrumentation.
+ *  Game code locks its mutexes through lockMutex() and
+ *  unlockMutex(). Built with -DLOCK_STATS (make lockstats)
+ *  every call site records how often it took the lock, how
+ *  long it waited for it and how long it held it. Otherwise
+ *  the macros are plain pthread calls
+ *  Refer to lockstat.c for detailed use of code
+****************************************************************/
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Struct to store the counters of one place a lock is taken from, shared
+// by that lock of every game so the counters are only updated atomically
+struct LockSite
+{
+    const char *lock_name;          // Expression naming the mutex
+    const char *func;               // Function taking the lock
+    pthread_mutex_t *mutex;         // Mutex taken by this site
+    unsigned long count;            // Number of acquisitions
+    unsigned long long wait_ns;     // Total time spent waiting to acquire
+    unsigned long long wait_max_ns;
+    unsigned long long hold_ns;     // Total time between acquire and release
+    unsigned long long hold_max_ns;
+    bool registered;                // Whether the site is in the site list
+    struct LockSite *next;          // Next site in the site list
+};
+
+#ifdef LOCK_STATS
+#define lockMutex(m) do { \
+        static struct LockSite lock_site_ = {#m, __func__}; \
+        lockStatAcquire((m), &lock_site_); \
+    } while (0)
+#define unlockMutex(m) lockStatRelease(m)
+#else
+#define lockMutex(m) pthread_mutex_lock(m)
+#define unlockMutex(m) pthread_mutex_unlock(m)
+#endif
+
+// Locks mutex and charges the wait to site
+void lockStatAcquire(pthread_mutex_t *mutex, struct LockSite *site);
+
+// Charges the hold time to the site that took mutex and unlocks it
+void lockStatRelease(pthread_mutex_t *mutex);
+
+// Prints one row per call site, prints nothing if no lock was instrumented
+void lockStatPrint(FILE *out);
+
+#endif
@@ -1,23 +1,173 @@
 
+#include "example.h"
 #include <stdio.h>
-#include "example.h" 
+#include "lockstat.h"
 
 /**
  * Things Implemented :-
  *  Basic Player that animates, moves in accordance with wasd key press and fires bullets
  *  Basic Caterpillar that animates moves and wrap aorunds and shoots bullet at random times
  *  Bulllets that move appropriately and die when out of bounds
- *  End conditions - quit and lose implemented 
+ *  Bullets kill caterpillars and take lives from the player
+ *  End conditions - quit, win and lose implemented 
  *  Joins all threads and releases all dynamic memory,
  * 	The only memory leaks shown in valgrind are due to ncurses library
- * 
- * Failed to implement advanced player and advanced caterpillar that are 
- * capable of interacting with bulletsS
+ *
+ * Command line options :-
+ *  --headless          Run the simulation without a terminal as fast as possible
+ *  --ticks N           Stop a headless run after N ticks
+ *  --script KEYS       Keys fed to a headless run in a loop, one every few ticks
+ *  --key-ticks N       Ticks between two scripted keys
+ *  --enemies N         Number of caterpillars in the wave
+ *  --spawn-ticks N     Ticks between two caterpillars instead of random intervals
+ *  --endless           Ignore win and lose conditions
+ *  --seed N            Seed of the pseudo randomizer instead of the clock
+ *  --record FILE       Write the seed and every applied input to an input log
+ *  --replay FILE       Play a recorded input log again tick by tick
+ *  --rows N            Board rows instead of the terminal height
+ *  --cols N            Board columns instead of the terminal width
+ *  --backend NAME      Draw with curses or with raw ANSI escapes (ansi)
+ *  --max-fps N         Most frames per second, 0 for no cap, frames are
+ *                      only presented when something on screen changed
+ *  --autoplay SECS     Let a bot play for SECS seconds, 0 until the game ends,
+ *                      the keyboard only quits. Headless games log to stderr
+ *  --soak-log FILE     Write resident memory, threads, live bullets and
+ *                      segments and tick times to FILE every few seconds
+ *  --soak-every SECS   Seconds between two lines of the soak log
 */
+
+/**
+ * Prints the command line options
+*/
+void printUsage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [--headless] [--ticks N] [--script KEYS] [--key-ticks N]\n"
+	                "       [--enemies N] [--spawn-ticks N] [--endless] [--seed N]\n"
+	                "       [--record FILE | --replay FILE] [--rows N] [--cols N]\n"
+	                "       [--backend curses|ansi] [--max-fps N] [--autoplay SECS]\n"
+	                "       [--soak-log FILE] [--soak-every SECS]\n", prog);
+}
+
+/**
+ * Prints how a headless game ended and how many
+ * ticks were simulated per second of wall clock time
+*/
+void printHeadlessReport(const struct GameReport *report)
+{
+	const char *status_names[] = {"running", "quit", "lost", "won", "error"};
+	double secs = report->run_ns / 1e9;
+
+	printf("status %s seed %u board %dx%d ticks %lu frames %lu score %u lives %u time %.3fs ticks/s %.0f\n",
+	       status_names[report->status], report->seed, report->rows, report->cols,
+	       report->ticks, report->frames, report->score, report->lives,
+	       secs, secs > 0 ? report->ticks / secs : 0.0);
+}
+
+/**
+ * Prints what the game allocated from its session arena, per kind of object
+*/
+void printMemory(const struct ArenaStats *m)
+{
+	unsigned long count = 0;
+	int i;
+
+	for (i = 0; i < ARENA_TAGS; i++)
+		count += m->count[i];
+
+	printf("Session memory: %.1f kB in %lu allocations, high water %.1f kB\n",
+	       m->used / 1024.0, count, m->high_water / 1024.0);
+	for (i = 0; i < ARENA_TAGS; i++)
+		if (m->count[i] > 0)
+			printf("  %-8s %4lu allocations %10.1f kB\n", arenaTagName(i),
+			       m->count[i], m->bytes[i] / 1024.0);
+	if (m->failed > 0)
+		printf("  %lu allocations did not fit\n", m->failed);
+}
+
 int main(int argc, char**argv) 
 {
+	struct GameOptions opts = {false, 0, NULL, SCRIPT_KEY_TICKS, DEFAULT_WAVE_SIZE, 0, false, 0, NULL, NULL, 0, 0, false, DEFAULT_MAX_FPS,
+	                           false, 0, NULL, SOAK_LOG_SECS};
+	struct GameReport report;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+			opts.headless = true;
+		else if (strcmp(argv[i], "--endless") == 0)
+			opts.endless = true;
+		else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+			opts.max_ticks = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+			opts.script = argv[++i];
+		else if (strcmp(argv[i], "--key-ticks") == 0 && i + 1 < argc)
+			opts.script_ticks = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--enemies") == 0 && i + 1 < argc)
+			opts.enemies = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--spawn-ticks") == 0 && i + 1 < argc)
+			opts.spawn_ticks = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			opts.seed = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			opts.record = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			opts.replay = argv[++i];
+		else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+			opts.rows = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cols") == 0 && i + 1 < argc)
+			opts.cols = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc
+		         && (strcmp(argv[i + 1], "curses") == 0 || strcmp(argv[i + 1], "ansi") == 0))
+			opts.ansi = strcmp(argv[++i], "ansi") == 0;
+		else if (strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+			opts.max_fps = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--autoplay") == 0 && i + 1 < argc)
+		{
+			opts.autoplay = true;
+			opts.autoplay_secs = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--soak-log") == 0 && i + 1 < argc)
+			opts.soak_log = argv[++i];
+		else if (strcmp(argv[i], "--soak-every") == 0 && i + 1 < argc)
+			opts.soak_secs = strtoul(argv[++i], NULL, 10);
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (opts.script_ticks == 0)
+		opts.script_ticks = 1;
+	if ((opts.record != NULL && opts.replay != NULL)
+	    || (opts.autoplay && (opts.replay != NULL || opts.script != NULL)))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
 	// Running the game
-	exampleRun();
+	exampleRun(&opts, &report);
+
+	if (opts.headless)
+		printHeadlessReport(&report);
+	if (report.shutdown_ns > 0)
+		printf("Shut down in %.3f ms\n", report.shutdown_ns / 1e6);
+	printMemory(&report.memory);
+	if (report.missed > 0)
+		printf("Missed %lu tick deadlines\n", report.missed);
+	if (report.spawns_dropped > 0)
+		printf("Dropped %lu spawn requests\n", report.spawns_dropped);
+	if (!opts.headless && report.frames > 0)
+		printf("Terminal output (%s): %.1f bytes and %.2f writes per frame over %lu frames\n",
+		       opts.ansi ? "ansi" : "curses", (double)report.bytes / report.frames,
+		       (double)report.writes / report.frames, report.frames);
+	if (report.render_stalls > 0)
+		printf("Waited %lu times for a full render ring\n", report.render_stalls);
+	if (report.input_latency.total > 0)
+		histPrint(&report.input_latency, stdout, "Input latency");
+	lockStatPrint(stdout);		// Only prints with make lockstats
+
 	// Print "done!" after successful exit from game
 	printf("done!\n");
 }
@@ -0,0 +1,556 @@
+#include "console.h"
+#include "render.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define RENDER_RING_MASK (RENDER_RING_SIZE - 1)
+
+// Console size and initial image handed to the render thread
+static int con_rows, con_cols;
+static char **con_image;
+
+// Whether commands run on the calling thread, for headless games
+static bool run_inline;
+
+// Producer rings, a thread registers its ring on its first command
+static struct RenderRing *rings[RENDER_MAX_PRODUCERS];
+static struct Arena *ring_arena;		// Session arena the rings come from
+static int num_rings;
+static unsigned int ring_gen;			// Bumped by renderFinish() to retire all rings
+static __thread struct RenderRing *my_ring;
+static __thread unsigned int my_ring_gen;
+
+// Render thread and the event it sleeps on between frames
+static pthread_t render_thread;
+static int wake_fd = -1;
+
+// Used by renderInit() and renderSync() to wait for the render thread
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sync_cond = PTHREAD_COND_INITIALIZER;
+static bool init_done, init_ok;
+
+// Owned by the render thread, or by the caller when running inline
+static struct RenderStats stats;
+static unsigned long long last_frame_ns;
+static unsigned long long stamps[RENDER_MAX_STAMPS];
+static int num_stamps;
+
+// Set by every command that changes the next frame, a frame
+// is only presented if something was queued since the last one
+static bool frame_damaged;
+
+/**
+ * Helper function that dumps the changed cells to the terminal and
+ * records how long the frame took and how old its key presses are
+ */
+static void presentFrame()
+{
+	unsigned long long start, end;
+	int i;
+
+	start = getTimeNsec();
+	consoleRefresh();
+	end = getTimeNsec();
+
+	stats.render_ns += end - start;
+	stats.frames++;
+	histRecord(&stats.frame_time, end - last_frame_ns);
+	last_frame_ns = end;
+
+	for (i = 0; i < num_stamps; i++)
+		histRecord(&stats.input_latency, end - stamps[i]);
+	num_stamps = 0;
+}
+
+/**
+ * Helper function that writes the input latency so far. Unless headless
+ * the terminal shows the game, so it goes to RENDER_DUMP_FILE instead
+ */
+static void writeLatency()
+{
+	FILE *f;
+
+	if (run_inline)
+	{
+		histPrint(&stats.input_latency, stderr, "Input latency");
+		return;
+	}
+
+	f = fopen(RENDER_DUMP_FILE, "a");
+	if (f == NULL)
+		return;
+	histPrint(&stats.input_latency, f, "Input latency");
+	fclose(f);
+}
+
+/**
+ * Helper function that runs one command on the console,
+ * returns true once the command asking to stop is reached
+ */
+static bool runCmd(struct RenderCmd *cmd)
+{
+	switch (cmd->op)
+	{
+	case RENDER_SPRITE:
+		consoleDrawSprite(cmd->row, cmd->col, cmd->sprite, cmd->frame);
+		break;
+	case RENDER_CLEAR:
+		consoleClearImage(cmd->row, cmd->col, cmd->height, cmd->width);
+		break;
+	case RENDER_STRING:
+		putString(cmd->text, cmd->row, cmd->col, cmd->width);
+		break;
+	case RENDER_BANNER:
+		putBanner(cmd->text);
+		break;
+	case RENDER_STAMP:
+		if (num_stamps < RENDER_MAX_STAMPS)
+			stamps[num_stamps++] = cmd->stamp;
+		break;
+	case RENDER_PRESENT:
+		presentFrame();
+		break;
+	case RENDER_DUMP:
+		writeLatency();
+		break;
+	case RENDER_STOP:
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Helper function that runs every command queued on any ring,
+ * returns true if one of them asked the render thread to stop
+ */
+static bool drainRings()
+{
+	struct RenderRing *r;
+	unsigned long head, tail;
+	bool stop = false;
+	int i, n;
+
+	n = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++)
+	{
+		// A ring may be counted before its pointer is stored
+		r = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+		if (r == NULL)
+			continue;
+
+		head = r->head;
+		tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		while (head != tail)
+		{
+			if (runCmd(&r->cmds[head & RENDER_RING_MASK]))
+				stop = true;
+			head++;
+			__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+		}
+	}
+	return stop;
+}
+
+/**
+ * Helper function that tells whether the render thread
+ * has caught up with every producer
+ */
+static bool ringsEmpty()
+{
+	struct RenderRing *r;
+	int i, n;
+
+	n = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++)
+	{
+		r = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+		if (r != NULL && __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Function run by the render thread, starts curses, then sleeps until
+ * a frame is presented and runs everything queued up to it
+ */
+static void *renderThreadFun(void *arg)
+{
+	eventfd_t events;
+	bool stop = false;
+	bool ok;
+
+	ok = consoleInit(con_rows, con_cols, con_image);
+
+	pthread_mutex_lock(&sync_lock);
+	init_ok = ok;
+	init_done = true;
+	pthread_cond_broadcast(&sync_cond);
+	pthread_mutex_unlock(&sync_lock);
+
+	if (!ok)
+	{
+		consoleFinish();
+		return NULL;
+	}
+
+	while (!stop)
+	{
+		eventfd_read(wake_fd, &events);
+		stop = drainRings();
+
+		// Let renderSync() callers check whether they are done
+		pthread_mutex_lock(&sync_lock);
+		pthread_cond_broadcast(&sync_cond);
+		pthread_mutex_unlock(&sync_lock);
+	}
+
+	finalKeypress(); /* wait for final key before killing curses and game */
+	consoleFinish();
+	return NULL;
+}
+
+/**
+ * Helper function that returns the ring of the calling thread,
+ * registering a new one on its first command. Returns NULL if
+ * there is no room for another producer
+ */
+static struct RenderRing *producerRing()
+{
+	struct RenderRing *r;
+	int i;
+
+	if (my_ring != NULL && my_ring_gen == ring_gen)
+		return my_ring;
+
+	i = __atomic_fetch_add(&num_rings, 1, __ATOMIC_ACQ_REL);
+	if (i >= RENDER_MAX_PRODUCERS)
+	{
+		__atomic_fetch_sub(&num_rings, 1, __ATOMIC_ACQ_REL);
+		return NULL;
+	}
+
+	r = arenaAlloc(ring_arena, ARENA_RENDER, sizeof(struct RenderRing));
+	if (r == NULL)
+		return NULL;
+	r->head = 0;
+	r->tail = 0;
+	r->stalls = 0;
+	r->texts = 0;
+	__atomic_store_n(&rings[i], r, __ATOMIC_RELEASE);
+	my_ring = r;
+	my_ring_gen = ring_gen;
+	return r;
+}
+
+/**
+ * Helper function that marks the next frame as changed
+ */
+static void damageFrame()
+{
+	if (!__atomic_load_n(&frame_damaged, __ATOMIC_RELAXED))
+		__atomic_store_n(&frame_damaged, true, __ATOMIC_RELAXED);
+}
+
+/**
+ * Helper function that wakes the render thread and waits until
+ * it has run the commands of a ring up to head
+ */
+static void waitForHead(struct RenderRing *r, unsigned long head)
+{
+	if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= head)
+		return;
+
+	r->stalls++;
+	do
+	{
+		eventfd_write(wake_fd, 1);
+		sched_yield();
+	} while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) < head);
+}
+
+/**
+ * Helper function that queues a command on the ring of the calling thread.
+ * A full ring wakes the render thread and waits for space, commands that
+ * end a frame wake it straight away. Strings are copied to a text slot
+ * of the ring, so the caller may reuse its buffer straight away
+ */
+static void pushCmd(struct RenderCmd *cmd)
+{
+	struct RenderRing *r;
+	unsigned long tail;
+	int slot;
+
+	if (run_inline)
+	{
+		runCmd(cmd);
+		return;
+	}
+
+	r = producerRing();
+	if (r == NULL)
+		return;
+
+	tail = r->tail;
+	if (tail >= RENDER_RING_SIZE)
+		waitForHead(r, tail - RENDER_RING_SIZE + 1);
+
+	// A slot is free once the command that last used it was run
+	if (cmd->op == RENDER_STRING || cmd->op == RENDER_BANNER)
+	{
+		slot = r->texts % RENDER_TEXT_SLOTS;
+		if (r->texts >= RENDER_TEXT_SLOTS)
+			waitForHead(r, r->text_cmd[slot] + 1);
+		strcpy(r->text[slot], cmd->text);
+		r->text_cmd[slot] = tail;
+		r->texts++;
+		cmd->text = r->text[slot];
+	}
+
+	r->cmds[tail & RENDER_RING_MASK] = *cmd;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (cmd->op == RENDER_PRESENT || cmd->op == RENDER_BANNER || cmd->op == RENDER_DUMP || cmd->op == RENDER_STOP)
+		eventfd_write(wake_fd, 1);
+}
+
+/**
+ * Function that starts the renderer and waits until the console is set up,
+ * a headless game keeps using the null renderer of the console inline
+ */
+bool renderInit(int rows, int cols, char *image[], bool headless, struct Arena *arena)
+{
+	bool ok;
+
+	ring_arena = arena;
+	consoleSetArena(arena);
+	memset(&stats, 0, sizeof(stats));
+	histReset(&stats.frame_time);
+	histReset(&stats.input_latency);
+	num_stamps = 0;
+	frame_damaged = false;
+	last_frame_ns = getTimeNsec();
+	run_inline = headless;
+
+	consoleSetHeadless(headless);
+	if (headless)
+	{
+		ok = consoleInit(rows, cols, image);
+		if (!ok)
+			consoleFinish();
+		return ok;
+	}
+
+	con_rows = rows;
+	con_cols = cols;
+	con_image = image;
+	init_done = false;
+
+	wake_fd = eventfd(0, 0);
+	if (wake_fd < 0)
+		return false;
+	if (pthread_create(&render_thread, NULL, renderThreadFun, NULL) != 0)
+	{
+		close(wake_fd);
+		return false;
+	}
+
+	pthread_mutex_lock(&sync_lock);
+	while (!init_done)
+		pthread_cond_wait(&sync_cond, &sync_lock);
+	ok = init_ok;
+	pthread_mutex_unlock(&sync_lock);
+
+	if (!ok)
+	{
+		pthread_join(render_thread, NULL);
+		close(wake_fd);
+	}
+	return ok;
+}
+
+/**
+ * Function that queues drawing a frame of a sprite
+ */
+void renderDrawSprite(int row, int col, const struct Sprite *sprite, int frame)
+{
+	struct RenderCmd cmd;
+
+	cmd.op = RENDER_SPRITE;
+	cmd.row = row;
+	cmd.col = col;
+	cmd.sprite = sprite;
+	cmd.frame = frame;
+	pushCmd(&cmd);
+	damageFrame();
+}
+
+/**
+ * Function that queues clearing a rectangle
+ */
+void renderClearImage(int row, int col, int height, int width)
+{
+	struct RenderCmd cmd;
+
+	cmd.op = RENDER_CLEAR;
+	cmd.row = row;
+	cmd.col = col;
+	cmd.height = height;
+	cmd.width = width;
+	pushCmd(&cmd);
+	damageFrame();
+}
+
+/**
+ * Function that queues drawing a string, the string is copied
+ * so the caller may reuse its buffer straight away
+ */
+void renderString(const char *str, int row, int col, int maxlen)
+{
+	struct RenderCmd cmd;
+	char text[RENDER_TEXT_LEN];
+
+	if (maxlen > RENDER_TEXT_LEN - 1)
+		maxlen = RENDER_TEXT_LEN - 1;
+
+	cmd.op = RENDER_STRING;
+	cmd.row = row;
+	cmd.col = col;
+	cmd.width = maxlen;
+	strncpy(text, str, maxlen);
+	text[maxlen] = '\0';
+	cmd.text = text;
+	pushCmd(&cmd);
+	damageFrame();
+}
+
+/**
+ * Function that queues a banner, banners are presented straight away
+ */
+void renderBanner(const char *str)
+{
+	struct RenderCmd cmd;
+	char text[RENDER_TEXT_LEN];
+
+	cmd.op = RENDER_BANNER;
+	strncpy(text, str, RENDER_TEXT_LEN - 1);
+	text[RENDER_TEXT_LEN - 1] = '\0';
+	cmd.text = text;
+	pushCmd(&cmd);
+}
+
+/**
+ * Function that queues the time a key press was read, its latency
+ * is recorded when the next frame is presented. A key press asks for
+ * a frame even if it changed nothing on screen
+ */
+void renderStamp(unsigned long long read_ns)
+{
+	struct RenderCmd cmd;
+
+	cmd.op = RENDER_STAMP;
+	cmd.stamp = read_ns;
+	pushCmd(&cmd);
+	damageFrame();
+}
+
+/**
+ * Function that ends a frame, everything queued before it reaches
+ * the terminal together. Nothing is queued and the render thread
+ * sleeps on if the frame would look like the last one
+ */
+bool renderPresent()
+{
+	struct RenderCmd cmd;
+
+	if (!__atomic_exchange_n(&frame_damaged, false, __ATOMIC_RELAXED))
+		return false;
+
+	cmd.op = RENDER_PRESENT;
+	pushCmd(&cmd);
+	return true;
+}
+
+/**
+ * Function that asks the renderer to write the input latency so far
+ */
+void renderDumpLatency()
+{
+	struct RenderCmd cmd;
+
+	cmd.op = RENDER_DUMP;
+	pushCmd(&cmd);
+}
+
+/**
+ * Function that wakes the render thread and waits until
+ * it has run every command queued so far
+ */
+void renderSync()
+{
+	if (run_inline)
+		return;
+
+	eventfd_write(wake_fd, 1);
+
+	pthread_mutex_lock(&sync_lock);
+	while (!ringsEmpty())
+		pthread_cond_wait(&sync_cond, &sync_lock);
+	pthread_mutex_unlock(&sync_lock);
+}
+
+/**
+ * Function that stops the renderer, the render thread runs what is
+ * left on every ring, waits for the final key and shuts curses down
+ */
+void renderFinish()
+{
+	struct RenderCmd cmd;
+	int i;
+
+	if (run_inline)
+	{
+		finalKeypress();
+		consoleFinish();
+		return;
+	}
+
+	cmd.op = RENDER_STOP;
+	pushCmd(&cmd);
+	pthread_join(render_thread, NULL);
+	close(wake_fd);
+	wake_fd = -1;
+
+	// Retire all rings, threads register new ones next time,
+	// their memory goes with the session arena
+	for (i = 0; i < num_rings; i++)
+	{
+		if (rings[i] == NULL)
+			continue;
+		stats.stalls += rings[i]->stalls;
+		rings[i] = NULL;
+	}
+	num_rings = 0;
+	ring_gen++;
+}
+
+/**
+ * Function that copies the renderer counters and the cell
+ * counts of the console
+ */
+void renderGetStats(struct RenderStats *out)
+{
+	struct ConsoleStats con;
+
+	*out = stats;
+	consoleGetStats(&con);
+	out->cells = con.cells;
+	out->scanned = con.scanned;
+	out->bytes = con.bytes;
+	out->writes = con.writes;
+}
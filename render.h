@@ -0,0 +1,128 @@
+/***************************************************************
+ *  Header file for the render thread. It is the only thread
+ *  that touches the console and curses, every other thread
+ *  queues draw, clear, string and banner commands on a ring
+ *  of its own and never waits for the terminal. Queued
+ *  commands reach the screen when their producer presents a
+ *  frame, and a frame is only presented if a command changed
+ *  it. A headless game runs every command straight away
+ *  on the calling thread instead, with no render thread
+ *  Refer to render.c for detailed use of code
+****************************************************************/
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include "histogram.h"
+
+struct Sprite;                      // Defined in console.h
+struct Arena;                       // Defined in arena.h
+
+// Capacity of each producer ring, must be a power of two
+#define RENDER_RING_SIZE 4096
+
+// Most threads that can queue commands
+#define RENDER_MAX_PRODUCERS 8
+
+// Longest string or banner a command can carry
+#define RENDER_TEXT_LEN 96
+
+// Strings each ring holds at once, a string waits for the render thread
+// to run the command of the string queued RENDER_TEXT_SLOTS before it
+#define RENDER_TEXT_SLOTS 64
+
+// File the input latency is appended to while the terminal shows the game
+#define RENDER_DUMP_FILE "centipede_latency.txt"
+
+// Most key press stamps waiting for a frame at once
+#define RENDER_MAX_STAMPS 64
+
+// Enumeration to store what a command does
+enum RenderOp
+{
+    RENDER_SPRITE,                  // consoleDrawSprite()
+    RENDER_CLEAR,                   // consoleClearImage()
+    RENDER_STRING,                  // putString()
+    RENDER_BANNER,                  // putBanner()
+    RENDER_STAMP,                   // Input read at stamp shows in the next frame
+    RENDER_PRESENT,                 // Flush changed cells to the terminal
+    RENDER_DUMP,                    // Write the input latency so far
+    RENDER_STOP                     // Wait for a final key and shut curses down
+};
+
+// Struct to store one queued command, kept small since every
+// command is copied onto a ring. Only the op picks the union member
+struct RenderCmd
+{
+    enum RenderOp op;
+    int row;                        // Upper left corner
+    int col;
+    int height;                     // Rows of the cleared rectangle
+    int width;                      // Columns cleared or longest string drawn
+    int frame;                      // Frame of the sprite drawn
+    union
+    {
+        const struct Sprite *sprite;    // Sprite drawn, sprites are static so
+                                        // only the pointer is queued
+        char *text;                 // String or banner drawn, in a text slot of the ring
+        unsigned long long stamp;   // Time the input was read
+    };
+};
+
+// Struct to store the ring of one producer thread
+struct RenderRing
+{
+    struct RenderCmd cmds[RENDER_RING_SIZE];
+    char text[RENDER_TEXT_SLOTS][RENDER_TEXT_LEN];  // Strings of queued commands
+    unsigned long text_cmd[RENDER_TEXT_SLOTS];      // Command that last used each slot
+    unsigned long texts;            // Strings queued so far
+    unsigned long head;             // Next command read by the render thread
+    unsigned long tail;             // Next command written by the producer
+    unsigned long stalls;           // Times the producer found the ring full
+};
+
+// Struct to store what the render thread did
+struct RenderStats
+{
+    unsigned long long render_ns;   // Time spent presenting frames
+    unsigned long frames;           // Frames presented
+    unsigned long stalls;           // Times a producer waited for ring space
+    unsigned long cells;            // Cells sent to the terminal
+    unsigned long scanned;          // Cells compared to find them
+    unsigned long long bytes;       // Bytes written to the terminal
+    unsigned long long writes;      // Write calls made for them
+    struct Histogram frame_time;    // Wall time between two presented frames
+    struct Histogram input_latency; // Key press to frame on terminal
+};
+
+// Starts the render thread, or the inline renderer when headless, and draws
+// the initial image. Rings and console buffers are allocated from arena.
+// Returns false if the console could not be set up
+bool renderInit(int rows, int cols, char *image[], bool headless, struct Arena *arena);
+
+// Queue commands on the ring of the calling thread
+void renderDrawSprite(int row, int col, const struct Sprite *sprite, int frame);
+void renderClearImage(int row, int col, int height, int width);
+void renderString(const char *str, int row, int col, int maxlen);
+void renderBanner(const char *str);
+void renderStamp(unsigned long long read_ns);
+
+// Ends the frame, returns false without queueing anything if no
+// command changed it since the last frame
+bool renderPresent(void);
+
+// Writes the input latency so far, to stderr when headless and to
+// RENDER_DUMP_FILE otherwise, so the live screen is left alone
+void renderDumpLatency(void);
+
+// Blocks until every command queued so far by any thread has run
+void renderSync(void);
+
+// Runs all queued commands, waits for a final key, shuts curses down and
+// joins the render thread. Must be called once after renderInit()
+void renderFinish(void);
+
+// Copies the counters, only meaningful after renderFinish()
+void renderGetStats(struct RenderStats *out);
+
+#endif
@@ -0,0 +1,222 @@
+/***************************************************************
+ *  Runner for many games in one process. Games are created
+ *  with the library interface of example.h and split across
+ *  worker threads, one per core by default, each thread
+ *  pinned to its core and stepping only its own games. One
+ *  JSON object with the ticks simulated per second over all
+ *  games is printed when every game reached its tick limit
+ *  Usage: centipede_runner [--games N] [--threads N] [--ticks N]
+ *                          [--enemies N] [--rows N] [--cols N]
+ *                          [--seed N] [--agent random|bot|none]
+****************************************************************/
+
+#include "console.h"
+#include "example.h"
+#include <sched.h>
+
+// Games and ticks per game unless given on the command line
+#define RUNNER_GAMES 64
+#define RUNNER_TICKS 20000
+
+// Ticks a thread steps one game for before moving to its next game
+#define RUNNER_BATCH 64
+
+// Enumeration to store what presses the keys of every game
+enum Agent
+{
+    AGENT_NONE,                 // Nobody, caterpillars walk down undisturbed
+    AGENT_RANDOM,               // A random action every tick
+    AGENT_BOT                   // The autoplay bot of the game
+};
+
+// Struct to store one worker thread and the games it owns, game i
+// belongs to thread i % threads
+struct Shard
+{
+    pthread_t thread;
+    int index;                  // Index of the thread, also its first game
+    int cpu;                    // Core the thread is pinned to, -1 for none
+    unsigned int rand_seed;     // State of the random agent of the thread
+    bool ok;                    // False if one of its games could not be created
+};
+
+// Actions the random agent picks from, moving half the time
+static const enum GameAction RANDOM_ACTIONS[] = {ACTION_NONE, ACTION_NONE, ACTION_NONE, ACTION_FIRE,
+                                                 ACTION_LEFT, ACTION_RIGHT, ACTION_UP, ACTION_DOWN};
+
+// Shared by every thread, written before they start
+static struct GameOptions base_options;
+static struct Game **games;
+static int num_games;
+static int num_threads;
+static enum Agent agent;
+
+// Threads create their games, then all start stepping at once
+static pthread_barrier_t start_barrier;
+
+/**
+ * Function run by each worker thread, creates its games so their
+ * memory is touched first from its core, then steps them round
+ * robin a batch of ticks at a time until all of them ended
+ */
+static void *shardThreadFun(void *arg)
+{
+	struct Shard *shard = arg;
+	struct GameOptions opts = base_options;
+	enum GameAction action;
+	cpu_set_t cpus;
+	bool running;
+	int i, t;
+
+	if (shard->cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(shard->cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	shard->ok = true;
+	for (i = shard->index; i < num_games; i += num_threads)
+	{
+		opts.seed = base_options.seed + i;
+		games[i] = gameCreate(&opts);
+		if (games[i] == NULL)
+			shard->ok = false;
+	}
+	pthread_barrier_wait(&start_barrier);
+
+	do
+	{
+		running = false;
+		for (i = shard->index; i < num_games; i += num_threads)
+		{
+			if (games[i] == NULL)
+				continue;
+			for (t = 0; t < RUNNER_BATCH; t++)
+			{
+				action = ACTION_NONE;
+				if (agent == AGENT_RANDOM)
+					action = RANDOM_ACTIONS[rand_r(&shard->rand_seed) % 8];
+				if (gameStep(games[i], action) != Running)
+					break;
+			}
+			running = running || t == RUNNER_BATCH;
+		}
+	} while (running);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct Shard *shards;
+	struct GameReport report;
+	unsigned long long start_ns, run_ns, ticks = 0;
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	bool ok = true;
+	double secs;
+	int i;
+
+	base_options = (struct GameOptions){true, RUNNER_TICKS, NULL, SCRIPT_KEY_TICKS, DEFAULT_WAVE_SIZE, 0, true,
+	                                    1, NULL, NULL, MIN_GAME_ROWS, MIN_GAME_COLS, false, 0,
+	                                    false, 0, NULL, SOAK_LOG_SECS};
+	num_games = RUNNER_GAMES;
+	num_threads = cpus > 0 ? cpus : 1;
+	agent = AGENT_RANDOM;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+			num_games = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			num_threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+			base_options.max_ticks = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--enemies") == 0 && i + 1 < argc)
+			base_options.enemies = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+			base_options.rows = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cols") == 0 && i + 1 < argc)
+			base_options.cols = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			base_options.seed = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--agent") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "none") == 0)
+				agent = AGENT_NONE;
+			else if (strcmp(argv[i], "random") == 0)
+				agent = AGENT_RANDOM;
+			else if (strcmp(argv[i], "bot") == 0)
+				agent = AGENT_BOT;
+			else
+				break;
+		}
+		else
+			break;
+	}
+	if (i < argc || num_games < 1 || num_threads < 1 || base_options.max_ticks == 0)
+	{
+		fprintf(stderr, "Usage: %s [--games N] [--threads N] [--ticks N] [--enemies N]\n"
+		                "       [--rows N] [--cols N] [--seed N] [--agent random|bot|none]\n", argv[0]);
+		return 1;
+	}
+	if (base_options.rows < MIN_GAME_ROWS || base_options.rows > MAX_GAME_ROWS
+	    || base_options.cols < MIN_GAME_COLS || base_options.cols > MAX_GAME_COLS)
+	{
+		fprintf(stderr, "Boards from %dx%d to %dx%d are supported\n",
+		        MIN_GAME_ROWS, MIN_GAME_COLS, MAX_GAME_ROWS, MAX_GAME_COLS);
+		return 1;
+	}
+
+	// More threads than games would leave some without work
+	if (num_threads > num_games)
+		num_threads = num_games;
+	base_options.autoplay = agent == AGENT_BOT;
+
+	games = calloc(num_games, sizeof(struct Game *));
+	shards = calloc(num_threads, sizeof(struct Shard));
+	if (games == NULL || shards == NULL)
+		return 1;
+
+	// The main thread waits at the barrier too, so timing starts
+	// once every game was created
+	pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+	for (i = 0; i < num_threads; i++)
+	{
+		shards[i].index = i;
+		shards[i].cpu = cpus > 0 ? i % cpus : -1;
+		shards[i].rand_seed = base_options.seed + i;
+		pthread_create(&shards[i].thread, NULL, shardThreadFun, &shards[i]);
+	}
+	pthread_barrier_wait(&start_barrier);
+	start_ns = getTimeNsec();
+
+	for (i = 0; i < num_threads; i++)
+	{
+		pthread_join(shards[i].thread, NULL);
+		ok = ok && shards[i].ok;
+	}
+	run_ns = getTimeNsec() - start_ns;
+	pthread_barrier_destroy(&start_barrier);
+
+	for (i = 0; i < num_games; i++)
+	{
+		if (games[i] == NULL)
+			continue;
+		gameGetReport(games[i], &report);
+		ticks += report.ticks;
+		gameDestroy(games[i]);
+	}
+	free(games);
+	free(shards);
+
+	secs = run_ns / 1e9;
+	printf("{\"games\":%d,\"threads\":%d,\"ticks\":%llu,\"seconds\":%.3f,"
+	       "\"ticks_per_sec\":%.0f,\"ticks_per_sec_per_thread\":%.0f}\n",
+	       num_games, num_threads, ticks, secs,
+	       secs > 0 ? ticks / secs : 0.0, secs > 0 ? ticks / secs / num_threads : 0.0);
+
+	if (!ok)
+		fprintf(stderr, "Some games could not be created\n");
+	return ok ? 0 : 1;
+}
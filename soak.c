@@ -0,0 +1,101 @@
+#include "soak.h"
+#include <string.h>
+
+/**
+ * Function that opens the log and schedules its first line
+ */
+bool soakOpen(struct SoakLog *log, const char *path, unsigned int interval_secs,
+              unsigned long long now_ns)
+{
+	memset(log, 0, sizeof(*log));
+	if (path != NULL)
+	{
+		log->out = fopen(path, "w");
+		if (log->out == NULL)
+			return false;
+		log->owned = true;
+	}
+	else
+		log->out = stderr;
+
+	if (interval_secs == 0)
+		interval_secs = 1;
+	log->interval_ns = interval_secs * 1000000000ULL;
+	log->start_ns = now_ns;
+	log->next_ns = now_ns + log->interval_ns;
+	log->last_tick_ns = now_ns;
+	return true;
+}
+
+/**
+ * Function that keeps the longest time between two ticks,
+ * which is the time spent on a tick in a headless game
+ */
+bool soakTick(struct SoakLog *log, unsigned long long now_ns)
+{
+	if (now_ns - log->last_tick_ns > log->tick_ns_max)
+		log->tick_ns_max = now_ns - log->last_tick_ns;
+	log->last_tick_ns = now_ns;
+	return now_ns >= log->next_ns;
+}
+
+/**
+ * Helper function that reads the resident memory in kB and
+ * the live threads of the process, -1 for what it cannot read
+ */
+static void readProcStatus(long *rss_kb, long *threads)
+{
+	char line[128];
+	FILE *f = fopen("/proc/self/status", "r");
+
+	*rss_kb = -1;
+	*threads = -1;
+	if (f == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		if (strncmp(line, "VmRSS:", 6) == 0)
+			sscanf(line + 6, "%ld", rss_kb);
+		else if (strncmp(line, "Threads:", 8) == 0)
+			sscanf(line + 8, "%ld", threads);
+	}
+	fclose(f);
+}
+
+/**
+ * Function that writes one line, tick times are averaged over the
+ * ticks since the last line and the longest one is reported too
+ */
+void soakWrite(struct SoakLog *log, const struct SoakCounts *counts, unsigned long long now_ns)
+{
+	unsigned long ticks = counts->ticks - log->last_ticks;
+	double secs = (now_ns - (log->next_ns - log->interval_ns)) / 1e9;
+	long rss_kb, threads;
+
+	readProcStatus(&rss_kb, &threads);
+
+	fprintf(log->out, "soak %.1fs ticks %lu (%.0f/s) tick avg %.3fms max %.3fms missed %lu"
+	        " rss %ldkB threads %ld bullets %d/%d segments %d/%d score %u lives %u\n",
+	        (now_ns - log->start_ns) / 1e9, counts->ticks, secs > 0 ? ticks / secs : 0.0,
+	        ticks > 0 ? secs * 1e3 / ticks : 0.0, log->tick_ns_max / 1e6,
+	        counts->missed - log->last_missed, rss_kb, threads,
+	        counts->bullets, counts->bullet_slots, counts->segments, counts->segment_slots,
+	        counts->score, counts->lives);
+	fflush(log->out);
+
+	log->last_ticks = counts->ticks;
+	log->last_missed = counts->missed;
+	log->tick_ns_max = 0;
+	log->next_ns = now_ns + log->interval_ns;
+}
+
+/**
+ * Function that closes the log
+ */
+void soakClose(struct SoakLog *log)
+{
+	if (log->owned && log->out != NULL)
+		fclose(log->out);
+	log->out = NULL;
+}
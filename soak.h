@@ -0,0 +1,59 @@
+/***************************************************************
+ *  Header file for soak test logs. Over a long game a line is
+ *  written every interval with the resident memory and live
+ *  threads of the process, the live bullets and segments of
+ *  the game and how long its ticks took, so leaks and slow
+ *  downs show up as numbers that keep growing
+ *  Refer to soak.c for detailed use of code
+****************************************************************/
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Default seconds between two lines
+#define SOAK_LOG_SECS 10
+
+// Struct to store what the game has at the time of a line
+struct SoakCounts
+{
+    unsigned long ticks;            // Ticks processed so far
+    unsigned long missed;           // Tick deadlines missed so far
+    int bullets;                    // Bullets in flight
+    int bullet_slots;               // Bullet pool slots ever used
+    int segments;                   // Segments not shot yet
+    int segment_slots;              // Segment slots ever used
+    unsigned int score;
+    unsigned int lives;
+};
+
+// Struct to store an open soak log
+struct SoakLog
+{
+    FILE *out;
+    bool owned;                     // Whether out was opened by soakOpen()
+    unsigned long long interval_ns; // Time between two lines
+    unsigned long long start_ns;    // Time the log was opened
+    unsigned long long next_ns;     // Time the next line is due
+    unsigned long long last_tick_ns;    // Time of the last tick
+    unsigned long long tick_ns_max; // Longest tick since the last line
+    unsigned long last_ticks;       // Ticks and missed deadlines
+    unsigned long last_missed;      // at the last line
+};
+
+// Opens the log at path, or uses stderr when path is NULL.
+// Returns false if the file cannot be created
+bool soakOpen(struct SoakLog *log, const char *path, unsigned int interval_secs,
+              unsigned long long now_ns);
+
+// Notes that a tick ran at now_ns, returns whether a line is due
+bool soakTick(struct SoakLog *log, unsigned long long now_ns);
+
+// Writes a line with counts and the process numbers read from /proc
+void soakWrite(struct SoakLog *log, const struct SoakCounts *counts, unsigned long long now_ns);
+
+// Closes the log if soakOpen() opened it
+void soakClose(struct SoakLog *log);
+
+#endif
@@ -0,0 +1,75 @@
+#include "spawnqueue.h"
+
+#define SPAWN_QUEUE_MASK (SPAWN_QUEUE_SIZE - 1)
+
+/**
+ * Function that empties the queue, slot i is
+ * ready to be written by the producer of position i
+ */
+void spawnQueueInit(struct SpawnQueue *q)
+{
+	unsigned long i;
+
+	for (i = 0; i < SPAWN_QUEUE_SIZE; i++)
+		q->slots[i].seq = i;
+	q->tail = 0;
+	q->head = 0;
+	q->dropped = 0;
+}
+
+/**
+ * Function that claims the next position with a compare and swap
+ * and publishes the request once it is written. A slot the consumer
+ * has not read yet means the ring is full and the request is dropped
+ */
+bool spawnQueuePush(struct SpawnQueue *q, const struct SpawnRequest *req)
+{
+	unsigned long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	struct SpawnSlot *slot;
+	long diff;
+
+	while (true)
+	{
+		slot = &q->slots[pos & SPAWN_QUEUE_MASK];
+		diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0)
+		{
+			// Slot is free for this position, try to claim it
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0)
+		{
+			__atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+			return false;
+		}
+		else
+		{
+			// Another producer claimed it first
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->req = *req;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Function that takes the oldest published request and hands
+ * its slot back to producers one lap of the ring later
+ */
+bool spawnQueuePop(struct SpawnQueue *q, struct SpawnRequest *req)
+{
+	struct SpawnSlot *slot = &q->slots[q->head & SPAWN_QUEUE_MASK];
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != q->head + 1)
+		return false;
+
+	*req = slot->req;
+	__atomic_store_n(&slot->seq, q->head + SPAWN_QUEUE_SIZE, __ATOMIC_RELEASE);
+	q->head++;
+	return true;
+}
@@ -0,0 +1,51 @@
+/***************************************************************
+ *  Header file for a bounded lock-free ring buffer with many
+ *  producers and a single consumer. Threads that want something
+ *  spawned push a request and never block, the simulation
+ *  thread drains all requests once per tick
+ *  Refer to spawnqueue.c for detailed use of code
+****************************************************************/
+#ifndef SPAWNQUEUE_H
+#define SPAWNQUEUE_H
+
+#include <stdbool.h>
+
+// Capacity of the ring, must be a power of two
+#define SPAWN_QUEUE_SIZE 256
+
+// Struct to store a request to spawn something, fields are game defined
+struct SpawnRequest
+{
+    int kind;                       // What to spawn
+    int row;                        // Where to spawn it
+    int col;
+    int direct;                     // Which way it heads
+};
+
+// Struct to store one slot of the ring
+struct SpawnSlot
+{
+    unsigned long seq;              // Position the slot is ready for, tells producers
+                                    // and the consumer whose turn it is
+    struct SpawnRequest req;
+};
+
+// Struct to store queue info
+struct SpawnQueue
+{
+    struct SpawnSlot slots[SPAWN_QUEUE_SIZE];
+    unsigned long tail;             // Next position claimed by a producer
+    unsigned long head;             // Next position read by the consumer
+    unsigned long dropped;          // Requests lost because the ring was full
+};
+
+// Empties the queue, must not run while other threads use it
+void spawnQueueInit(struct SpawnQueue *q);
+
+// Called from any thread, returns false and drops the request if the queue is full
+bool spawnQueuePush(struct SpawnQueue *q, const struct SpawnRequest *req);
+
+// Called from the consumer thread only, returns false if the queue is empty
+bool spawnQueuePop(struct SpawnQueue *q, struct SpawnRequest *req);
+
+#endif
@@ -0,0 +1,250 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Helper function that pushes a task to the bottom of the deque,
+ * returns false if the deque is full
+ */
+static bool dequePush(struct TaskDeque *dq, struct Task t)
+{
+	bool pushed = false;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom - dq->top < DEQUE_SIZE)
+	{
+		dq->tasks[dq->bottom & (DEQUE_SIZE - 1)] = t;
+		dq->bottom++;
+		pushed = true;
+	}
+	pthread_mutex_unlock(&dq->lock);
+
+	return pushed;
+}
+
+/**
+ * Helper function used by the owner to take the most recently
+ * pushed task from the bottom of its deque
+ */
+static bool dequePop(struct TaskDeque *dq, struct Task *t)
+{
+	bool popped = false;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom != dq->top)
+	{
+		dq->bottom--;
+		*t = dq->tasks[dq->bottom & (DEQUE_SIZE - 1)];
+		popped = true;
+	}
+	pthread_mutex_unlock(&dq->lock);
+
+	return popped;
+}
+
+/**
+ * Helper function used by thieves to take the oldest
+ * task from the top of another deque
+ */
+static bool dequeSteal(struct TaskDeque *dq, struct Task *t)
+{
+	bool stolen = false;
+
+	// Avoid waiting on a deque that is busy, try another victim instead
+	if (pthread_mutex_trylock(&dq->lock) != 0)
+		return false;
+
+	if (dq->bottom != dq->top)
+	{
+		*t = dq->tasks[dq->top & (DEQUE_SIZE - 1)];
+		dq->top++;
+		stolen = true;
+	}
+	pthread_mutex_unlock(&dq->lock);
+
+	return stolen;
+}
+
+/**
+ * Helper function that finds the next task for a worker,
+ * first from its own deque then from a random victim onwards
+ */
+static bool findTask(struct Worker *w, struct Task *t)
+{
+	struct ThreadPool *pool = w->pool;
+	int i, victim;
+
+	if (dequePop(&w->deque, t))
+		return true;
+
+	victim = rand_r(&w->seed) % pool->num_workers;
+	for (i = 0; i < pool->num_workers; i++)
+	{
+		if (victim != w->id && dequeSteal(&pool->workers[victim].deque, t))
+			return true;
+		victim = (victim + 1) % pool->num_workers;
+	}
+	return false;
+}
+
+/**
+ * Helper function that runs a task and wakes up
+ * poolWait() once the last pending task is done
+ */
+static void runTask(struct ThreadPool *pool, struct Task t)
+{
+	t.fun(t.arg);
+
+	if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_broadcast(&pool->done_cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+/**
+ * Function that runs tasks until the pool is stopped,
+ * sleeps on the pool condition while no task is queued anywhere
+ */
+static void *workerThreadFun(void *arg)
+{
+	struct Worker *w = (struct Worker *)arg;
+	struct ThreadPool *pool = w->pool;
+	struct Task t;
+
+	while (true)
+	{
+		if (findTask(w, &t))
+		{
+			__atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+			runTask(pool, t);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 && !pool->stop)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+
+		if (pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return NULL;
+}
+
+/**
+ * Function that allocates the workers and starts their threads
+ */
+bool poolInit(struct ThreadPool *pool, int num_workers, struct Arena *arena)
+{
+	int i, j;
+
+	if (num_workers <= 0)
+		num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_workers <= 0)
+		num_workers = 1;
+
+	pool->workers = (struct Worker *) arenaAlloc(arena, ARENA_WORKERS, num_workers * sizeof(struct Worker));
+	if (pool->workers == NULL)
+		return false;
+
+	pool->num_workers = num_workers;
+	pool->next_worker = 0;
+	pool->queued = 0;
+	pool->pending = 0;
+	pool->stop = false;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		struct Worker *w = &pool->workers[i];
+		w->id = i;
+		w->seed = i + 1;
+		w->pool = pool;
+		w->deque.top = 0;
+		w->deque.bottom = 0;
+		pthread_mutex_init(&w->deque.lock, NULL);
+	}
+
+	for (i = 0; i < num_workers; i++)
+	{
+		if (pthread_create(&pool->workers[i].thread, NULL, workerThreadFun, &pool->workers[i]) != 0)
+		{
+			// Stop and join the workers already started, the rest never ran
+			for (j = i; j < num_workers; j++)
+				pthread_mutex_destroy(&pool->workers[j].deque.lock);
+			pool->num_workers = i;
+			poolDestroy(pool);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Function that hands a task to the workers round robin,
+ * the task is run by the caller if the chosen deque is full
+ */
+void poolSubmit(struct ThreadPool *pool, void (*fun)(void *), void *arg)
+{
+	struct Task t = {fun, arg};
+	unsigned int w = __atomic_fetch_add(&pool->next_worker, 1, __ATOMIC_RELAXED) % pool->num_workers;
+
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+	__atomic_add_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+
+	if (!dequePush(&pool->workers[w].deque, t))
+	{
+		__atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+		runTask(pool, t);
+		return;
+	}
+
+	// Taking the lock orders the wake up after a sleeping worker checked queued
+	pthread_mutex_lock(&pool->lock);
+	pthread_cond_signal(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Function that waits for all submitted tasks to finish
+ */
+void poolWait(struct ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) != 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Function that lets workers finish queued tasks,
+ * joins them and releases the memory
+ */
+void poolDestroy(struct ThreadPool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_workers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	for (i = 0; i < pool->num_workers; i++)
+		pthread_mutex_destroy(&pool->workers[i].deque.lock);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	pool->workers = NULL;
+}
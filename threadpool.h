@@ -0,0 +1,77 @@
+/***************************************************************
+ *  Header file for a fixed size pool of worker threads.
+ *  Every worker owns a deque of tasks, it pops its own work
+ *  from the bottom and steals from the top of other workers
+ *  deques when it runs out.
+ *  Refer to threadpool.c for detailed use of code
+****************************************************************/
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "arena.h"
+
+// Capacity of each worker deque, must be a power of two
+#define DEQUE_SIZE 4096
+
+// Struct to store a unit of work
+struct Task
+{
+    void (*fun)(void *arg);         // Function to be run by a worker
+    void *arg;                      // Argument passed to the function
+};
+
+// Struct to store tasks queued on one worker
+struct TaskDeque
+{
+    struct Task tasks[DEQUE_SIZE];  // Ring buffer of tasks
+    unsigned int top;               // Index thieves steal from
+    unsigned int bottom;            // Index owner pushes to and pops from
+    pthread_mutex_t lock;           // Mutex lock of the deque
+};
+
+struct ThreadPool;
+
+// Struct to store worker info
+struct Worker
+{
+    int id;                         // Index of worker in the pool
+    unsigned int seed;              // Seed used to pick a victim to steal from
+    struct TaskDeque deque;         // Tasks queued on this worker
+    struct ThreadPool *pool;        // Pool the worker belongs to
+    pthread_t thread;               // Thread that runs the tasks
+};
+
+// Struct to store pool info
+struct ThreadPool
+{
+    int num_workers;                // Number of worker threads
+    struct Worker *workers;         // Array of workers
+
+    unsigned int next_worker;       // Worker that receives the next submitted task
+    int queued;                     // Tasks sitting in any deque
+    int pending;                    // Tasks submitted but not finished yet
+    bool stop;                      // Set when workers have to exit
+
+    pthread_mutex_t lock;           // Lock used to sleep and wake workers
+    pthread_cond_t work_cond;       // Signalled when tasks are submitted
+    pthread_cond_t done_cond;       // Signalled when pending hits zero
+};
+
+// Starts num_workers threads, one per online core if num_workers <= 0,
+// the workers are allocated from arena. Returns false with no worker
+// left running if they could not all be started
+bool poolInit(struct ThreadPool *pool, int num_workers, struct Arena *arena);
+
+// Queues fun(arg) on one of the workers
+void poolSubmit(struct ThreadPool *pool, void (*fun)(void *), void *arg);
+
+// Blocks until every submitted task has finished
+void poolWait(struct ThreadPool *pool);
+
+// Stops and joins all workers, their memory goes with the arena
+void poolDestroy(struct ThreadPool *pool);
+
+#endif
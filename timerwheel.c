@@ -0,0 +1,210 @@
+#include "timerwheel.h"
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+
+#define NSEC_PER_SEC 1000000000L
+
+/**
+ * Helper function that links a timer into the slot
+ * matching how far in the future it expires
+ */
+static void wheelInsert(struct TimerWheel *w, struct Timer *t)
+{
+	unsigned long delta = t->expires - w->now;
+	int level = 0;
+	int slot;
+
+	// Find the lowest level whose span covers the delay
+	while (level < WHEEL_LEVELS - 1 && delta >= (1UL << (WHEEL_BITS * (level + 1))))
+		level++;
+
+	// Timers too far away wait in the last slot of the top level
+	if (delta >= (1UL << (WHEEL_BITS * WHEEL_LEVELS)))
+		t->expires = w->now + (1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+	slot = (t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	t->next = w->slots[level][slot];
+	w->slots[level][slot] = t;
+	t->active = true;
+}
+
+/**
+ * Helper function that moves every timer of a higher level slot
+ * down to the levels below now that they are closer
+ */
+static void wheelCascade(struct TimerWheel *w, int level)
+{
+	int slot = (w->now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	struct Timer *t = w->slots[level][slot];
+	struct Timer *next;
+
+	w->slots[level][slot] = NULL;
+	while (t != NULL)
+	{
+		next = t->next;
+		wheelInsert(w, t);
+		t = next;
+	}
+}
+
+/**
+ * Function that processes one tick, cascading higher levels
+ * when the lower one wraps and running the timers that are due
+ */
+void wheelStep(struct TimerWheel *w)
+{
+	struct Timer *t;
+	struct Timer *next;
+	int level;
+
+	w->now++;
+
+	for (level = 1; level < WHEEL_LEVELS; level++)
+	{
+		if ((w->now >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+			break;
+		wheelCascade(w, level);
+	}
+
+	// Detach the slot first so callbacks can re-arm their own timer
+	t = w->slots[0][w->now & WHEEL_MASK];
+	w->slots[0][w->now & WHEEL_MASK] = NULL;
+
+	while (t != NULL)
+	{
+		next = t->next;
+		t->active = false;
+
+		// Periodic timers keep their absolute schedule
+		if (t->period > 0)
+		{
+			t->expires += t->period;
+			wheelInsert(w, t);
+		}
+		t->fun(t->arg);
+		t = next;
+	}
+}
+
+/**
+ * Helper function that returns the absolute time of the deadline of a tick
+ */
+static struct timespec wheelDeadline(struct TimerWheel *w, unsigned long tick)
+{
+	struct timespec ts = w->start;
+	unsigned long long nsec = (unsigned long long) tick * w->tick_nsec + ts.tv_nsec;
+
+	ts.tv_sec += nsec / NSEC_PER_SEC;
+	ts.tv_nsec = nsec % NSEC_PER_SEC;
+	return ts;
+}
+
+/**
+ * Function that initializes an empty wheel
+ */
+void wheelInit(struct TimerWheel *w, long tick_nsec)
+{
+	memset(w->slots, 0, sizeof(w->slots));
+	w->now = 0;
+	w->missed = 0;
+	w->tick_nsec = tick_nsec;
+	w->stop_fd = -1;
+	clock_gettime(CLOCK_MONOTONIC, &w->start);
+}
+
+/**
+ * Function that sets the event that ends a sleep early
+ */
+void wheelSetStopEvent(struct TimerWheel *w, int fd)
+{
+	w->stop_fd = fd;
+}
+
+/**
+ * Helper function that sleeps until an absolute deadline or until the
+ * stop event is readable, returns false if the stop event ended it
+ */
+static bool wheelSleep(struct TimerWheel *w, const struct timespec *deadline)
+{
+	struct pollfd pfd = {w->stop_fd, POLLIN, 0};
+	struct timespec now, left;
+	int n;
+
+	if (w->stop_fd < 0)
+	{
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+			;
+		return true;
+	}
+
+	while (true)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		left.tv_sec = deadline->tv_sec - now.tv_sec;
+		left.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+		if (left.tv_nsec < 0)
+		{
+			left.tv_sec--;
+			left.tv_nsec += NSEC_PER_SEC;
+		}
+		if (left.tv_sec < 0)
+			return true;
+
+		n = ppoll(&pfd, 1, &left, NULL);
+		if (n > 0)
+			return false;
+		if (n == 0)
+			return true;
+		if (errno != EINTR)
+			return true;
+	}
+}
+
+/**
+ * Function that arms a timer, a timer that is already armed
+ * must not be added again before it expires
+ */
+void wheelAdd(struct TimerWheel *w, struct Timer *t, void (*fun)(void *), void *arg,
+              unsigned int delay, unsigned int period)
+{
+	if (delay == 0)
+		delay = 1;
+
+	t->fun = fun;
+	t->arg = arg;
+	t->period = period;
+	t->expires = w->now + delay;
+	wheelInsert(w, t);
+}
+
+/**
+ * Function that sleeps until the deadline of the next tick and
+ * processes every tick whose deadline has passed by then, unless
+ * the stop event comes first
+ */
+bool wheelRunTick(struct TimerWheel *w)
+{
+	struct timespec deadline = wheelDeadline(w, w->now + 1);
+	struct timespec now;
+	unsigned long long elapsed;
+	unsigned long target;
+
+	if (!wheelSleep(w, &deadline))
+		return false;
+
+	// Work out which tick we are really at, we may have overslept
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (unsigned long long)(now.tv_sec - w->start.tv_sec) * NSEC_PER_SEC
+	          + now.tv_nsec - w->start.tv_nsec;
+	target = elapsed / w->tick_nsec;
+
+	if (target <= w->now)
+		target = w->now + 1;
+	else if (target > w->now + 1)
+		w->missed += target - (w->now + 1);
+
+	while (w->now < target)
+		wheelStep(w);
+	return true;
+}
@@ -0,0 +1,62 @@
+/***************************************************************
+ *  Header file for a hierarchical timer wheel that runs
+ *  callbacks at absolute tick deadlines of a monotonic clock,
+ *  so time spent in callbacks does not stretch their periods
+ *  Refer to timerwheel.c for detailed use of code
+****************************************************************/
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+#define _GNU_SOURCE
+
+#include <time.h>
+#include <stdbool.h>
+
+// Wheel geometry, each level has 64 slots and covers 64 times
+// the span of the level below, 4 levels cover 2^24 ticks
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+// Struct to store a timer, owned by the caller
+struct Timer
+{
+    void (*fun)(void *arg);         // Callback run when the timer expires
+    void *arg;                      // Argument passed to the callback
+    unsigned long expires;          // Absolute tick the timer expires at
+    unsigned int period;            // Ticks between runs, 0 for a one shot timer
+    bool active;                    // Whether the timer is linked into the wheel
+    struct Timer *next;             // Next timer in the same slot
+};
+
+// Struct to store wheel info
+struct TimerWheel
+{
+    struct Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    unsigned long now;              // Last tick that was processed
+    long tick_nsec;                 // Length of a tick in nanoseconds
+    struct timespec start;          // Monotonic time of tick zero
+    unsigned long missed;           // Ticks processed after their deadline passed
+    int stop_fd;                    // Event that cuts the sleep short, -1 for none
+};
+
+// Initializes an empty wheel whose tick zero is now
+void wheelInit(struct TimerWheel *w, long tick_nsec);
+
+// Arms timer t to run fun(arg) delay ticks from now and every period ticks after
+void wheelAdd(struct TimerWheel *w, struct Timer *t, void (*fun)(void *), void *arg,
+              unsigned int delay, unsigned int period);
+
+// Processes the next tick straight away without looking at the clock
+void wheelStep(struct TimerWheel *w);
+
+// Makes the sleep of wheelRunTick() end as soon as fd is readable,
+// the event is left readable so it can wake other threads too
+void wheelSetStopEvent(struct TimerWheel *w, int fd);
+
+// Sleeps until the next tick deadline and runs every timer that is due,
+// catching up on all ticks that passed if the caller fell behind.
+// Returns false without running anything if the stop event woke it
+bool wheelRunTick(struct TimerWheel *w);
+
+#endif